@@ -32,6 +32,7 @@
 #include "agra.h"
 #include "ns3/log.h"
 #include "ns3/boolean.h"
+#include "ns3/string.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/inet-socket-address.h"
 #include "ns3/trace-source-accessor.h"
@@ -135,7 +136,15 @@ TypeId RoutingProtocol::GetTypeId(void) {
 					MakeDoubleChecker<double>()).AddAttribute("object_radius",
                                         "radius of obstacle in scenario",DoubleValue(0),
                                         MakeDoubleAccessor(&RoutingProtocol::object_radius),
-					MakeDoubleChecker<double>());
+					MakeDoubleChecker<double>()).AddAttribute("ObstacleFile",
+					"File of obstacles for RepulsionMode (see spider::ObstacleSet); replaces the locationX, locationY, object_radius hole.",
+					StringValue(""),
+					MakeStringAccessor(&RoutingProtocol::ObstacleFile),
+					MakeStringChecker()).AddAttribute("ObstacleInfluence",
+					"Distance beyond its radius up to which an obstacle repels packets (0 for no limit).",
+					DoubleValue(0),
+					MakeDoubleAccessor(&RoutingProtocol::ObstacleInfluence),
+					MakeDoubleChecker<double>(0));
 	/*.AddAttribute("RepulsionMode",
 	 "Indicates wheteher EGF avoidance is used or not",
 	 UintegerValue(1),
@@ -295,57 +304,51 @@ bool RoutingProtocol::SendPacketFromQueue(Ipv4Address dst) {
 	myPos.y = MM->GetPosition().y;
 	Ipv4Address nextHop;
 
-	if (m_neighbors.isNeighbour(dst)) {
-		nextHop = dst;
-	} else {
-		//std::cout << "We start at Greedy Forwarding on Queue!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "]"<< std::endl;
-		Vector dstPos = m_locationService->GetPosition(dst);
-		nextHop = m_neighbors.BestNeighbor(dstPos, myPos);
-		if (nextHop == Ipv4Address::GetZero()) {
-			NS_LOG_LOGIC("Fallback to recovery-mode. Packets to " << dst);
-			recovery = true;
-		}
-		if (recovery) {
-
-			Vector Position;
-			Vector previousHop;
-			uint32_t updated;
-
-			while (m_queue.Dequeue(dst, queueEntry)) {
-				Ptr<Packet> p = ConstCast<Packet>(queueEntry.GetPacket());
-				UnicastForwardCallback ucb =
-						queueEntry.GetUnicastForwardCallback();
-				Ipv4Header header = queueEntry.GetIpv4Header();
-
-				TypeHeader tHeader(AGRATYPE_POS);
-				p->RemoveHeader(tHeader);
-				if (!tHeader.IsValid()) {
-					NS_LOG_DEBUG(
-							"AGRA message " << p->GetUid()
-									<< " with unknown type received: "
-									<< tHeader.Get() << ". Drop");
-					return false;     // drop
-				}
-				if (tHeader.Get() == AGRATYPE_POS) {
-					PositionHeader hdr;
-					p->RemoveHeader(hdr);
-					Position.x = hdr.GetDstPosx();
-					Position.y = hdr.GetDstPosy();
-					updated = hdr.GetUpdated();
-				} else {
-					updated = 0;
-				}
-
-				PositionHeader posHeader(Position.x, Position.y, updated,
-						myPos.x, myPos.y, (uint8_t) 1, Position.x, Position.y);
-				p->AddHeader(posHeader); //enters in recovery with last edge from Dst
-				p->AddHeader(tHeader);
-
-				RecoveryMode(dst, p, ucb, header);
+	nextHop = m_engine->GreedyNextHop(m_neighbors, dst,
+			m_locationService->GetPosition(dst), myPos);
+	if (nextHop == Ipv4Address::GetZero()) {
+		NS_LOG_LOGIC("Fallback to recovery-mode. Packets to " << dst);
+		recovery = true;
+	}
+	if (recovery) {
+
+		Vector Position;
+		Vector previousHop;
+		uint32_t updated;
+
+		while (m_queue.Dequeue(dst, queueEntry)) {
+			Ptr<Packet> p = ConstCast<Packet>(queueEntry.GetPacket());
+			UnicastForwardCallback ucb =
+					queueEntry.GetUnicastForwardCallback();
+			Ipv4Header header = queueEntry.GetIpv4Header();
+
+			TypeHeader tHeader(AGRATYPE_POS);
+			p->RemoveHeader(tHeader);
+			if (!tHeader.IsValid()) {
+				NS_LOG_DEBUG(
+						"AGRA message " << p->GetUid()
+								<< " with unknown type received: "
+								<< tHeader.Get() << ". Drop");
+				return false;     // drop
 			}
-			return true;
+			if (tHeader.Get() == AGRATYPE_POS) {
+				PositionHeader hdr;
+				p->RemoveHeader(hdr);
+				Position.x = hdr.GetDstPosx();
+				Position.y = hdr.GetDstPosy();
+				updated = hdr.GetUpdated();
+			} else {
+				updated = 0;
+			}
+
+			PositionHeader posHeader(Position.x, Position.y, updated,
+					myPos.x, myPos.y, (uint8_t) 1, Position.x, Position.y);
+			p->AddHeader(posHeader); //enters in recovery with last edge from Dst
+			p->AddHeader(tHeader);
+
+			RecoveryMode(dst, p, ucb, header);
 		}
+		return true;
 	}
 	Ptr<Ipv4Route> route = Create<Ipv4Route>();
 	route->SetDestination(dst);
@@ -419,9 +422,7 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 	myPos.x = MM->GetPosition().x;
 	myPos.y = MM->GetPosition().y;
 
-	if (inRec == 1
-			&& CalculateDistance(myPos, Position)
-					< CalculateDistance(RecPosition, Position)) {
+	if (inRec == 1 && m_engine->LeaveRecovery(myPos, RecPosition, Position)) {
 		inRec = 0;
 		hdr.SetInRec(0);
 		NS_LOG_LOGIC("No longer in Recovery to " << dst << " in " << myPos);
@@ -444,27 +445,7 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 		updated = myUpdated;
 	}
 
-	Ipv4Address nextHop;
-
-	if (m_neighbors.isNeighbour(dst)) {
-		nextHop = dst;
-	} else if (RepulsionMode) {
-		//std::cout << "We start at Repulsion Mode!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-		//		<< (uint32_t) header.GetTtl() << " dstPos=" << Position << std::endl;
-		nextHop = m_neighbors.ElectrostaticBestNeighbor(Position, myPos, locationX, locationY, object_radius);
-                if (nextHop == Ipv4Address::GetZero()) {
-                //std::cout << "We switch to Greedy Forwarding!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-		//		<< (uint32_t) header.GetTtl() << std::endl;
-                    nextHop = m_neighbors.BestNeighbor(Position, myPos);                
-                }
-	} else {
-		//std::cout << "We start at Greedy Forwarding!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-	        //			<< (uint32_t) header.GetTtl() << std::endl;
-		nextHop = m_neighbors.BestNeighbor(Position, myPos);
-	}
+	Ipv4Address nextHop = m_engine->NextHop(m_neighbors, dst, Position, myPos);
 	if (nextHop != Ipv4Address::GetZero()) {
 		PositionHeader posHeader(Position.x, Position.y, updated, (uint64_t) 0,
 				(uint64_t) 0, (uint8_t) 0, myPos.x, myPos.y);
@@ -561,7 +542,7 @@ void RoutingProtocol::RecoveryMode(Ipv4Address dst, Ptr<Packet> p,
 	p->AddHeader(posHeader);
 	p->AddHeader(tHeader);
 
-	Ipv4Address nextHop = m_neighbors.BestAngle(previousHop, myPos);
+	Ipv4Address nextHop = m_engine->RecoveryNextHop(m_neighbors, previousHop, myPos);
 	//m_neighbors.PrintNeighbors(std::cout);
 	//std::cout << std::endl;
 	if (nextHop == Ipv4Address::GetZero()) {
@@ -843,11 +824,33 @@ bool RoutingProtocol::IsMyOwnAddress(Ipv4Address src) {
 	return false;
 }
 
+Ptr<spider::ObstacleSet> RoutingProtocol::GetObstacles() const {
+	if (!ObstacleFile.empty()) {
+		return spider::ObstacleSet::Load(ObstacleFile, ObstacleInfluence);
+	}
+	Ptr<spider::ObstacleSet> obstacles = Create<spider::ObstacleSet>();
+	obstacles->SetInfluenceRadius(ObstacleInfluence);
+	obstacles->AddCircle(locationX, locationY, object_radius);
+	return obstacles;
+}
+
 void RoutingProtocol::Start() {
 	//std::cout<<"AGRA protocol has started at node["<<m_ipv4->GetObject<Node>()->GetId()<<"]"<<std::endl;
 	NS_LOG_FUNCTION(this);
 	m_queuedAddresses.clear();
 
+	// AGRA is SPIDER without the energy term; the configuration is fixed for
+	// the lifetime of the protocol
+	if (RepulsionMode) {
+		m_engine = spider::MakeForwardingEngine(
+				spider::ElectrostaticScoring<spider::GreedyScoring>(
+						spider::GreedyScoring(), GetObstacles(), 1),
+				spider::RightHandRecovery());
+	} else {
+		m_engine = spider::MakeForwardingEngine(spider::GreedyScoring(),
+				spider::RightHandRecovery());
+	}
+
 	//FIXME ajustar timer, meter valor parametrizavel
 	Time tableTime("2s");
 
@@ -910,14 +913,8 @@ void RoutingProtocol::AddHeaders(Ptr<Packet> p, Ipv4Address source,
 	myPos.x = MM->GetPosition().x;
 	myPos.y = MM->GetPosition().y;
 
-	Ipv4Address nextHop;
-
-	if (m_neighbors.isNeighbour(destination)) {
-		nextHop = destination;
-	} else {
-		nextHop = m_neighbors.BestNeighbor(
-				m_locationService->GetPosition(destination), myPos);
-	}
+	Ipv4Address nextHop = m_engine->GreedyNextHop(m_neighbors, destination,
+			m_locationService->GetPosition(destination), myPos);
 
 	uint64_t positionX = 0;
 	uint64_t positionY = 0;
@@ -1002,21 +999,7 @@ Ptr<Ipv4Route> RoutingProtocol::RouteOutput(Ptr<Packet> p,
 	myPos.x = MM->GetPosition().x;
 	myPos.y = MM->GetPosition().y;
 
-	Ipv4Address nextHop;
-
-	if (m_neighbors.isNeighbour(dst)) {
-		nextHop = dst;
-	} else if (false) {
-		std::cout << "We start at Repulsion Mode!" << "[node "
-				<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-				<< (uint32_t) header.GetTtl() << std::endl;
-		nextHop = m_neighbors.ElectrostaticBestNeighbor(dstPos, myPos,locationX,locationY,object_radius);
-	} else {
-		//std::cout << "We start at Greedy Forwarding!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-		//		<< (uint32_t) header.GetTtl() << std::endl;
-		nextHop = m_neighbors.BestNeighbor(dstPos, myPos);
-	}
+	Ipv4Address nextHop = m_engine->GreedyNextHop(m_neighbors, dst, dstPos, myPos);
 
 	if (nextHop != Ipv4Address::GetZero()) {
 		NS_LOG_DEBUG("Destination: " << dst);
@@ -3,6 +3,7 @@
   if (m_ipv4) { std::clog << "[node " << m_ipv4->GetObject<Node> ()->GetId () << "] "; } 
 
 #include "god.h"
+#include "node-directory.h"
 #include "ns3/log.h"
 #include "ns3/mobility-model.h"
 #include "ns3/node-list.h"
@@ -38,29 +39,12 @@ GodLocationService::Start ()
 }
 
 
-//FIX THIS
 Vector
 GodLocationService::GetPosition(Ipv4Address adr)
 {
-  uint32_t n = NodeList().GetNNodes ();
-  uint32_t i;
-  Ptr<Node> node;
-  
-  //NS_LOG_UNCOND("Position of " << adr);
-  
-  for(i = 0; i < n; i++)
-    {
-      node = NodeList().GetNode (i);
-      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-
-      //NS_LOG_UNCOND("Have " << ipv4->GetAddress (1, 0).GetLocal ());     
-      if(ipv4->GetAddress (1, 0).GetLocal () == adr)
-	{
-	  return (*node->GetObject<MobilityModel>()).GetPosition ();
-	}
-    }
-  Vector v;
-  return v;
+  Vector position;
+  NodeDirectory::GetPosition (adr, position);
+  return position;
 }
   
   bool
@@ -49,8 +49,30 @@ public:
   virtual void Purge () = 0;
   virtual void Clear () = 0;
 
+  /**
+   * \brief Sets the callback run with a destination whose search ended
+   *
+   * Runs once the answer arrived or the search gave up, HasPosition tells
+   * which. Services that never search do not run it.
+   */
+  void SetSearchDoneCallback (Callback<void, Ipv4Address> cb)
+  {
+    m_searchDone = cb;
+  }
+
+protected:
+  /// To be called by the implementations when the search for id ends
+  void NotifySearchDone (Ipv4Address id)
+  {
+    if (!m_searchDone.IsNull ())
+      {
+        m_searchDone (id);
+      }
+  }
+
 private:
   void Start ();
+  Callback<void, Ipv4Address> m_searchDone;
 };
 }
 #endif
@@ -0,0 +1,65 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+#ifndef NODE_DIRECTORY_H
+#define NODE_DIRECTORY_H
+
+#include "ns3/node.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/mobility-model.h"
+#include "ns3/vector.h"
+#include <map>
+
+namespace ns3
+{
+/**
+ * \ingroup location-service
+ *
+ * \brief Global directory from an IPv4 address to the node that owns it
+ *
+ * Replaces NodeList walks in position lookups. Routing helpers fill it at
+ * install time and routing protocols keep it current from their address
+ * notifications. Addresses that were never registered are resolved once
+ * by walking the NodeList and then cached.
+ */
+class NodeDirectory
+{
+public:
+  struct Entry
+  {
+    Ptr<Node> node;
+    Ptr<MobilityModel> mobility;   ///< resolved lazily, mobility may be installed after addressing
+    uint32_t index;                ///< node id, i.e. index in the NodeList
+  };
+
+  /// Registers address as owned by node
+  static void Add (Ipv4Address address, Ptr<Node> node);
+  /// Registers every non-loopback address of node
+  static void AddNode (Ptr<Node> node);
+  /// Forgets address
+  static void Remove (Ipv4Address address);
+  /// Forgets every address
+  static void Clear ();
+
+  /**
+   * \param address the address to look up
+   * \return the entry of the node that owns address, 0 if no node does
+   */
+  static const Entry * Find (Ipv4Address address);
+  /// \return node owning address, 0 if none
+  static Ptr<Node> GetNode (Ipv4Address address);
+  /// \return mobility model of the node owning address, 0 if none
+  static Ptr<MobilityModel> GetMobility (Ipv4Address address);
+  /**
+   * \param address the address to look up
+   * \param position set to the current position of the owning node
+   * \return false if no node with a mobility model owns address
+   */
+  static bool GetPosition (Ipv4Address address, Vector &position);
+
+private:
+  typedef std::map<Ipv4Address, Entry> Map;
+  static Map & GetMap ();
+  /// Walks the NodeList for the owner of address and registers it
+  static Entry * Resolve (Ipv4Address address);
+};
+}
+#endif /* NODE_DIRECTORY_H */
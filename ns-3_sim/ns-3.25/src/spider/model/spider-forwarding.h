@@ -0,0 +1,579 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/****************************************************************************/
+/* This file is part of SPIDER project.                                       */
+/*                                                                          */
+/* SPIDER is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by     */
+/* the Free Software Foundation, either version 3 of the License, or        */
+/* (at your option) any later version.                                      */
+/*                                                                          */
+/* SPIDER is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of           */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
+/* GNU General Public License for more details.                             */
+/*                                                                          */
+/* You should have received a copy of the GNU General Public License        */
+/* along with SPIDER.  If not, see <http://www.gnu.org/licenses/>.            */
+/*                                                                          */
+/****************************************************************************/
+/*                                                                          */
+/*  Author:    Dmitrii Chemodanov, University of Missouri-Columbia          */
+/*  Title:     SPIDER: AI-augmented Geographic Routing Approach for IoT-based */
+/*             Incident-Supporting Applications                             */
+/*  Revision:  1.0         6/19/2017                                        */
+/****************************************************************************/
+#ifndef SPIDER_FORWARDING_H
+#define SPIDER_FORWARDING_H
+
+#include "spider-ptable.h"
+#include "ns3/simple-ref-count.h"
+#include "ns3/vector.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv4-route.h"
+#include "ns3/nstime.h"
+#include <cmath>
+#include <map>
+#include <vector>
+
+namespace ns3 {
+namespace spider {
+
+/*
+ * Next-hop selection is split in two policies that a ForwardingEngine is
+ * instantiated with:
+ *
+ *  - a scoring policy ranks the neighbours that make progress towards the
+ *    destination (Select) and, for policies that bend the path around
+ *    obstacles, provides the plain greedy step (SelectGreedy) used where no
+ *    field is applied (route output, queued packets); SelectAll and
+ *    SelectAllGreedy rank the best few of them for multipath forwarding;
+ *  - a recovery policy walks around voids once scoring finds no neighbour
+ *    (Select) and tells when the packet may go back to scoring (Leave).
+ *
+ * Every configuration is its own type, so the per-packet path of a protocol
+ * instance has no mode branches; the routing protocol picks the type once,
+ * from its attributes, in Start ().
+ */
+
+/**
+ * \ingroup spider
+ * \brief Greedy forwarding: the neighbour closest to the destination
+ */
+struct GreedyScoring
+{
+  Ipv4Address Select (PositionTable &table, Vector dstPos, Vector myPos) const
+  {
+    return table.GreedyNeighbor (dstPos, myPos);
+  }
+  Ipv4Address SelectGreedy (PositionTable &table, Vector dstPos, Vector myPos) const
+  {
+    return table.GreedyNeighbor (dstPos, myPos);
+  }
+  void SelectAll (PositionTable &table, Vector dstPos, Vector myPos, uint32_t k, double slack,
+                  std::vector<WeightedNeighbor> &hops) const
+  {
+    table.BestNeighbors (dstPos, myPos, 1, k, slack, hops);
+  }
+  void SelectAllGreedy (PositionTable &table, Vector dstPos, Vector myPos, uint32_t k, double slack,
+                        std::vector<WeightedNeighbor> &hops) const
+  {
+    table.BestNeighbors (dstPos, myPos, 1, k, slack, hops);
+  }
+};
+
+/**
+ * \ingroup spider
+ * \brief SPIDER forwarding: progress weighted against residual energy by lamda
+ */
+struct EnergyWeightedScoring
+{
+  explicit EnergyWeightedScoring (double lamda)
+    : lamda (lamda)
+  {
+  }
+  Ipv4Address Select (PositionTable &table, Vector dstPos, Vector myPos) const
+  {
+    return table.BestNeighbor (dstPos, myPos, lamda);
+  }
+  Ipv4Address SelectGreedy (PositionTable &table, Vector dstPos, Vector myPos) const
+  {
+    return table.BestNeighbor (dstPos, myPos, lamda);
+  }
+  void SelectAll (PositionTable &table, Vector dstPos, Vector myPos, uint32_t k, double slack,
+                  std::vector<WeightedNeighbor> &hops) const
+  {
+    table.BestNeighbors (dstPos, myPos, lamda, k, slack, hops);
+  }
+  void SelectAllGreedy (PositionTable &table, Vector dstPos, Vector myPos, uint32_t k, double slack,
+                        std::vector<WeightedNeighbor> &hops) const
+  {
+    table.BestNeighbors (dstPos, myPos, lamda, k, slack, hops);
+  }
+  double lamda;         ///< weight of progress, 1 - lamda weights energy
+};
+
+/**
+ * \ingroup spider
+ * \brief Electrostatics based greedy forwarding (EGF) around a set of obstacles
+ *
+ * Falls back to the Greedy policy when no neighbour lowers the potential.
+ * The field already steers each packet, so it is not spread over several
+ * next hops: SelectAll keeps the single Select choice.
+ */
+template <class Greedy>
+struct ElectrostaticScoring
+{
+  ElectrostaticScoring (const Greedy &greedy, Ptr<ObstacleSet> obstacles, double lamda)
+    : greedy (greedy),
+      obstacles (obstacles),
+      lamda (lamda)
+  {
+  }
+  Ipv4Address Select (PositionTable &table, Vector dstPos, Vector myPos) const
+  {
+    Ipv4Address nextHop = table.ElectrostaticBestNeighbor (dstPos, myPos, *obstacles, lamda);
+    if (nextHop == Ipv4Address::GetZero ())
+      {
+        nextHop = greedy.Select (table, dstPos, myPos);
+      }
+    return nextHop;
+  }
+  Ipv4Address SelectGreedy (PositionTable &table, Vector dstPos, Vector myPos) const
+  {
+    return greedy.SelectGreedy (table, dstPos, myPos);
+  }
+  void SelectAll (PositionTable &table, Vector dstPos, Vector myPos, uint32_t, double,
+                  std::vector<WeightedNeighbor> &hops) const
+  {
+    hops.clear ();
+    Ipv4Address nextHop = Select (table, dstPos, myPos);
+    if (nextHop != Ipv4Address::GetZero ())
+      {
+        hops.push_back (WeightedNeighbor (nextHop, 1));
+      }
+  }
+  void SelectAllGreedy (PositionTable &table, Vector dstPos, Vector myPos, uint32_t k, double slack,
+                        std::vector<WeightedNeighbor> &hops) const
+  {
+    greedy.SelectAllGreedy (table, dstPos, myPos, k, slack, hops);
+  }
+  Greedy greedy;
+  Ptr<ObstacleSet> obstacles;   ///< obstacles repelling the packets
+  double lamda;                 ///< weight of the potential, 1 - lamda weights energy
+};
+
+/**
+ * \ingroup spider
+ * \brief Right hand rule on the planarized neighbourhood
+ *
+ * Faces are walked on the horizontal projection of the neighbourhood (see
+ * PositionTable::BestAngle), while the packet goes back to scoring once it
+ * is closer, in 3D, to the destination than the node where it entered
+ * recovery. As in GPSR, the packet changes face where an edge crosses the
+ * line from that node to the destination closer to it than the point the
+ * current face was entered at.
+ */
+struct RightHandRecovery
+{
+  Ipv4Address Select (PositionTable &table, Vector previousHop, Vector myPos) const
+  {
+    return table.BestAngle (previousHop, myPos);
+  }
+  bool Leave (Vector myPos, Vector recPos, Vector dstPos) const
+  {
+    return CalculateDistance (myPos, dstPos) < CalculateDistance (recPos, dstPos);
+  }
+  bool ChangeFace (Vector myPos, Vector nextPos, Vector recPos, Vector dstPos, Vector &entry) const
+  {
+    // solve myPos + t * (nextPos - myPos) = recPos + u * (dstPos - recPos)
+    double ex = nextPos.x - myPos.x;
+    double ey = nextPos.y - myPos.y;
+    double lx = dstPos.x - recPos.x;
+    double ly = dstPos.y - recPos.y;
+    double denom = ex * ly - ey * lx;
+    if (denom == 0)
+      {
+        return false; // parallel, or a degenerate edge
+      }
+    double wx = recPos.x - myPos.x;
+    double wy = recPos.y - myPos.y;
+    double t = (wx * ly - wy * lx) / denom;
+    double u = (wx * ey - wy * ex) / denom;
+    if (t <= 0 || t > 1 || u < 0 || u > 1)
+      {
+        return false;
+      }
+    Vector crossing (recPos.x + u * lx, recPos.y + u * ly, 0);
+    Vector dst (dstPos.x, dstPos.y, 0);
+    Vector current (entry.x, entry.y, 0);
+    // beyond the resolution of the positions carried in the header
+    if (CalculateDistance (crossing, dst) > CalculateDistance (current, dst) - 0.05)
+      {
+        return false;
+      }
+    entry = crossing;
+    return true;
+  }
+};
+
+/**
+ * \ingroup spider
+ * \brief Interface of a forwarding configuration, see ForwardingEngine
+ */
+class ForwardingEngineBase : public SimpleRefCount<ForwardingEngineBase>
+{
+public:
+  virtual ~ForwardingEngineBase ()
+  {
+  }
+  /**
+   * \brief Next hop of a packet in greedy mode
+   * \param table the neighbour table of this node
+   * \param dst the destination address; returned if it is a neighbour
+   * \param dstPos the position of the destination
+   * \param myPos the position of this node
+   * \return Ipv4Address of the next hop, Ipv4Address::GetZero () to enter recovery-mode
+   */
+  virtual Ipv4Address NextHop (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos) const = 0;
+  /// As NextHop, without the obstacle field of electrostatic scoring
+  virtual Ipv4Address GreedyNextHop (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos) const = 0;
+  /**
+   * \brief Next hops of a packet in greedy mode, for multipath forwarding
+   * \param k the maximum number of next hops
+   * \param slack the maximum objective gap of a next hop to the best one, see PositionTable::BestNeighbors
+   * \param hops set to the next hops, best first; only dst if it is a neighbour, empty to enter recovery-mode
+   */
+  virtual void NextHops (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos,
+                         uint32_t k, double slack, std::vector<WeightedNeighbor> &hops) const = 0;
+  /// As NextHops, without the obstacle field of electrostatic scoring
+  virtual void GreedyNextHops (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos,
+                               uint32_t k, double slack, std::vector<WeightedNeighbor> &hops) const = 0;
+  /// Next hop of a packet in recovery-mode, Ipv4Address::GetZero () if there is none
+  virtual Ipv4Address RecoveryNextHop (PositionTable &table, Vector previousHop, Vector myPos) const = 0;
+  /// Returns true if a packet that entered recovery at recPos may go back to greedy mode
+  virtual bool LeaveRecovery (Vector myPos, Vector recPos, Vector dstPos) const = 0;
+  /**
+   * \brief Face change test of recovery-mode
+   * \param myPos the position of this node
+   * \param nextPos the position of the next hop chosen on the current face
+   * \param recPos the position of the node that entered recovery-mode
+   * \param dstPos the position of the destination
+   * \param entry the point the current face was entered at, moved to the new face entry point
+   * \return true if the packet has to leave the current face on the edge to nextPos
+   */
+  virtual bool ChangeFace (Vector myPos, Vector nextPos, Vector recPos, Vector dstPos, Vector &entry) const = 0;
+};
+
+/**
+ * \ingroup spider
+ * \brief Forwarding decisions of one scoring and one recovery policy
+ */
+template <class Scoring, class Recovery>
+class ForwardingEngine : public ForwardingEngineBase
+{
+public:
+  ForwardingEngine (const Scoring &scoring, const Recovery &recovery)
+    : m_scoring (scoring),
+      m_recovery (recovery)
+  {
+  }
+  virtual Ipv4Address NextHop (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos) const
+  {
+    if (table.isNeighbour (dst))
+      {
+        return dst;
+      }
+    return m_scoring.Select (table, dstPos, myPos);
+  }
+  virtual Ipv4Address GreedyNextHop (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos) const
+  {
+    if (table.isNeighbour (dst))
+      {
+        return dst;
+      }
+    return m_scoring.SelectGreedy (table, dstPos, myPos);
+  }
+  virtual void NextHops (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos,
+                         uint32_t k, double slack, std::vector<WeightedNeighbor> &hops) const
+  {
+    if (table.isNeighbour (dst))
+      {
+        hops.assign (1, WeightedNeighbor (dst, 1));
+        return;
+      }
+    m_scoring.SelectAll (table, dstPos, myPos, k, slack, hops);
+  }
+  virtual void GreedyNextHops (PositionTable &table, Ipv4Address dst, Vector dstPos, Vector myPos,
+                               uint32_t k, double slack, std::vector<WeightedNeighbor> &hops) const
+  {
+    if (table.isNeighbour (dst))
+      {
+        hops.assign (1, WeightedNeighbor (dst, 1));
+        return;
+      }
+    m_scoring.SelectAllGreedy (table, dstPos, myPos, k, slack, hops);
+  }
+  virtual Ipv4Address RecoveryNextHop (PositionTable &table, Vector previousHop, Vector myPos) const
+  {
+    return m_recovery.Select (table, previousHop, myPos);
+  }
+  virtual bool LeaveRecovery (Vector myPos, Vector recPos, Vector dstPos) const
+  {
+    return m_recovery.Leave (myPos, recPos, dstPos);
+  }
+  virtual bool ChangeFace (Vector myPos, Vector nextPos, Vector recPos, Vector dstPos, Vector &entry) const
+  {
+    return m_recovery.ChangeFace (myPos, nextPos, recPos, dstPos, entry);
+  }
+
+private:
+  Scoring m_scoring;
+  Recovery m_recovery;
+};
+
+/**
+ * \ingroup spider
+ * \brief Creates the engine of a configuration
+ */
+template <class Scoring, class Recovery>
+Ptr<ForwardingEngineBase>
+MakeForwardingEngine (const Scoring &scoring, const Recovery &recovery)
+{
+  return Create<ForwardingEngine<Scoring, Recovery> > (scoring, recovery);
+}
+
+/**
+ * \ingroup spider
+ * \brief Next hops chosen recently, per destination and forwarding mode
+ *
+ * A decision is reused while the epoch of the neighbour table (see
+ * PositionTable::GetEpoch) is unchanged and neither this node nor the
+ * destination left the cell, of side SetCellSize, it was in when the next
+ * hop was chosen. The route handed down with the next hop is kept along,
+ * so that consecutive packets of a flow share it.
+ */
+class NextHopCache
+{
+public:
+  /// The ForwardingEngineBase decision cached
+  enum Mode
+  {
+    NEXT_HOP,           ///< NextHop
+    GREEDY_NEXT_HOP,    ///< GreedyNextHop
+  };
+
+  NextHopCache ()
+    : m_cellSize (0)
+  {
+  }
+  /// Sets the cell side in meters, zero disables the cache
+  void SetCellSize (double size)
+  {
+    m_cellSize = size;
+    m_entries.clear ();
+    m_hopSets.clear ();
+  }
+  bool IsEnabled () const
+  {
+    return m_cellSize > 0;
+  }
+  /**
+   * \brief Looks a decision up
+   * \param nextHop set to the cached next hop, Ipv4Address::GetZero () for recovery-mode
+   * \return true on a hit
+   */
+  bool Lookup (Ipv4Address dst, Mode mode, Vector dstPos, Vector myPos, uint32_t epoch, Ipv4Address &nextHop) const
+  {
+    Entries::const_iterator i = m_entries.find (std::make_pair (dst, mode));
+    if (i == m_entries.end () || i->second.epoch != epoch
+        || !SameCell (i->second.dstPos, dstPos) || !SameCell (i->second.myPos, myPos))
+      {
+        return false;
+      }
+    nextHop = i->second.nextHop;
+    return true;
+  }
+  /// Stores a decision, replacing the one of dst and mode
+  void Insert (Ipv4Address dst, Mode mode, Vector dstPos, Vector myPos, uint32_t epoch, Ipv4Address nextHop)
+  {
+    Entry &e = m_entries[std::make_pair (dst, mode)];
+    if (e.nextHop != nextHop)
+      {
+        e.route = 0;
+      }
+    e.dstPos = dstPos;
+    e.myPos = myPos;
+    e.epoch = epoch;
+    e.nextHop = nextHop;
+  }
+  /// Route stored with the decision of dst and mode, 0 if none
+  Ptr<Ipv4Route> GetRoute (Ipv4Address dst, Mode mode) const
+  {
+    Entries::const_iterator i = m_entries.find (std::make_pair (dst, mode));
+    return i == m_entries.end () ? Ptr<Ipv4Route> () : i->second.route;
+  }
+  /// Stores route with the decision of dst and mode, if there is one
+  void SetRoute (Ipv4Address dst, Mode mode, Ptr<Ipv4Route> route)
+  {
+    Entries::iterator i = m_entries.find (std::make_pair (dst, mode));
+    if (i != m_entries.end ())
+      {
+        i->second.route = route;
+      }
+  }
+  /// As Lookup, for the next hops of a multipath decision
+  bool LookupHops (Ipv4Address dst, Mode mode, Vector dstPos, Vector myPos, uint32_t epoch,
+                   std::vector<WeightedNeighbor> &hops) const
+  {
+    HopSets::const_iterator i = m_hopSets.find (std::make_pair (dst, mode));
+    if (i == m_hopSets.end () || i->second.epoch != epoch
+        || !SameCell (i->second.dstPos, dstPos) || !SameCell (i->second.myPos, myPos))
+      {
+        return false;
+      }
+    hops = i->second.hops;
+    return true;
+  }
+  /// As Insert, for the next hops of a multipath decision
+  void InsertHops (Ipv4Address dst, Mode mode, Vector dstPos, Vector myPos, uint32_t epoch,
+                   const std::vector<WeightedNeighbor> &hops)
+  {
+    HopSet &e = m_hopSets[std::make_pair (dst, mode)];
+    e.dstPos = dstPos;
+    e.myPos = myPos;
+    e.epoch = epoch;
+    e.hops = hops;
+  }
+  void Clear ()
+  {
+    m_entries.clear ();
+    m_hopSets.clear ();
+  }
+
+private:
+  struct Entry
+  {
+    Vector dstPos;              ///< destination position the decision was taken for
+    Vector myPos;               ///< position of this node when it was taken
+    uint32_t epoch;             ///< neighbour table epoch when it was taken
+    Ipv4Address nextHop;
+    Ptr<Ipv4Route> route;       ///< last route built for nextHop, reusable while its source matches
+  };
+  typedef std::map<std::pair<Ipv4Address, Mode>, Entry> Entries;
+  struct HopSet
+  {
+    Vector dstPos;
+    Vector myPos;
+    uint32_t epoch;
+    std::vector<WeightedNeighbor> hops;
+  };
+  typedef std::map<std::pair<Ipv4Address, Mode>, HopSet> HopSets;
+
+  bool SameCell (Vector a, Vector b) const
+  {
+    return std::floor (a.x / m_cellSize) == std::floor (b.x / m_cellSize)
+           && std::floor (a.y / m_cellSize) == std::floor (b.y / m_cellSize)
+           && std::floor (a.z / m_cellSize) == std::floor (b.z / m_cellSize);
+  }
+
+  double m_cellSize;
+  Entries m_entries;
+  HopSets m_hopSets;
+};
+
+/**
+ * \ingroup spider
+ * \brief Spreads the packets of each flow over its next hops
+ *
+ * A flow, the packets from one source to one destination, takes its next
+ * hops in smooth weighted round-robin: every packet adds the weight of each
+ * hop to its credit and goes to the hop with the highest credit, which then
+ * pays the sum of the weights back. Hops of equal weight alternate, and a
+ * hop of half the weight of another gets one packet in three, interleaved.
+ * How far packets of a flow may be reordered depends on how much the paths
+ * differ, which the slack of the candidate hops bounds, not on this class.
+ */
+class FlowSpreader
+{
+public:
+  FlowSpreader ()
+    : m_idleTimeout (Seconds (10))
+  {
+  }
+  /// Forgets the credits of the flows without a packet for timeout
+  void SetIdleTimeout (Time timeout)
+  {
+    m_idleTimeout = timeout;
+  }
+  /**
+   * \brief Next hop of a packet of the flow from source to dst
+   * \param hops the candidate next hops and their weights, not empty
+   * \param now the current time
+   */
+  Ipv4Address Select (Ipv4Address source, Ipv4Address dst, const std::vector<WeightedNeighbor> &hops, Time now)
+  {
+    if (now - m_lastPurge > m_idleTimeout)
+      {
+        Purge (now);
+      }
+    Flow &flow = m_flows[std::make_pair (source, dst)];
+    flow.lastUsed = now;
+    // hops that left the candidates lose their credit
+    Credits credits;
+    double total = 0;
+    Ipv4Address best;
+    double bestCredit = 0;
+    for (std::vector<WeightedNeighbor>::const_iterator i = hops.begin (); i != hops.end (); ++i)
+      {
+        Credits::const_iterator c = flow.credits.find (i->first);
+        double credit = (c == flow.credits.end () ? 0 : c->second) + i->second;
+        credits[i->first] = credit;
+        total += i->second;
+        if (i == hops.begin () || credit > bestCredit)
+          {
+            best = i->first;
+            bestCredit = credit;
+          }
+      }
+    credits[best] -= total;
+    flow.credits.swap (credits);
+    return best;
+  }
+  void Clear ()
+  {
+    m_flows.clear ();
+  }
+
+private:
+  typedef std::map<Ipv4Address, double> Credits;
+  struct Flow
+  {
+    Credits credits;
+    Time lastUsed;
+  };
+  typedef std::map<std::pair<Ipv4Address, Ipv4Address>, Flow> Flows;
+
+  void Purge (Time now)
+  {
+    for (Flows::iterator i = m_flows.begin (); i != m_flows.end ();)
+      {
+        if (now - i->second.lastUsed > m_idleTimeout)
+          {
+            m_flows.erase (i++);
+          }
+        else
+          {
+            ++i;
+          }
+      }
+    m_lastPurge = now;
+  }
+
+  Time m_idleTimeout;
+  Time m_lastPurge;
+  Flows m_flows;
+};
+
+}
+}
+#endif /* SPIDER_FORWARDING_H */
@@ -0,0 +1,164 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/****************************************************************************/
+/* This file is part of SPIDER project.                                       */
+/*                                                                          */
+/* SPIDER is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by     */
+/* the Free Software Foundation, either version 3 of the License, or        */
+/* (at your option) any later version.                                      */
+/*                                                                          */
+/* SPIDER is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of           */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
+/* GNU General Public License for more details.                             */
+/*                                                                          */
+/* You should have received a copy of the GNU General Public License        */
+/* along with SPIDER.  If not, see <http://www.gnu.org/licenses/>.            */
+/*                                                                          */
+/****************************************************************************/
+/*                                                                          */
+/*  Author:    Dmitrii Chemodanov, University of Missouri-Columbia          */
+/*  Title:     SPIDER: AI-augmented Geographic Routing Approach for IoT-based */
+/*             Incident-Supporting Applications                             */
+/*  Revision:  1.0         6/19/2017                                        */
+/****************************************************************************/
+#ifndef SPIDER_KERNELS_H
+#define SPIDER_KERNELS_H
+
+#include <stdint.h>
+
+namespace ns3 {
+namespace spider {
+
+/**
+ * \ingroup spider
+ * \brief Instruction sets the kernels have a path for
+ */
+enum KernelIsa
+{
+  KERNEL_ISA_SCALAR,
+  KERNEL_ISA_SSE2,
+  KERNEL_ISA_AVX2
+};
+
+/**
+ * \ingroup spider
+ * \brief Returns the widest path the CPU supports, the one used by default
+ */
+KernelIsa GetSupportedKernelIsa ();
+
+/**
+ * \ingroup spider
+ * \brief Restricts the kernels to the paths up to isa
+ *
+ * Meant for tests comparing the paths; isa is capped at
+ * GetSupportedKernelIsa ().
+ *
+ * \return the path now in use
+ */
+KernelIsa SetKernelIsa (KernelIsa isa);
+
+/**
+ * \ingroup spider
+ * \brief Right-hand-rule pseudo-angles for a batch of neighbours
+ *
+ * For every neighbour i at (x[i], y[i]) writes to angle[i] a value in [0, 4)
+ * that grows monotonically with the counterclockwise angle, in [0, 360)
+ * degrees, between the edge centre->node i and the edge centre->ref (the
+ * quantity PositionTable::GetAngle returns). It is 0 when the two edges are
+ * aligned or either one is degenerate.
+ *
+ * Uses AVX2 when the CPU supports it and a scalar loop otherwise; both paths
+ * give bitwise identical results.
+ */
+void RhrPseudoAngles (const double *x, const double *y, uint32_t n,
+                      double centreX, double centreY, double refX, double refY,
+                      double *angle);
+
+/**
+ * \ingroup spider
+ * \brief Normalization ranges of the candidates of a scoring pass
+ */
+struct ScoreRanges
+{
+  double minMetric;   ///< lowest routing metric among the candidates
+  double maxMetric;   ///< highest routing metric among the candidates
+  double minEnergy;   ///< lowest residual energy among the candidates
+  double maxEnergy;   ///< highest residual energy among the candidates
+};
+
+/**
+ * \ingroup spider
+ * \brief Distance pass of the greedy objective
+ *
+ * Writes to metric[i] the distance from neighbour i to the target (tx, ty, tz).
+ * Neighbours with metric[i] < bound are candidates; their metric and energy
+ * ranges are accumulated in ranges.
+ *
+ * \return the number of candidates
+ */
+uint32_t DistanceRanges (const double *x, const double *y, const double *z,
+                         const double *energy, uint32_t n,
+                         double tx, double ty, double tz, double bound,
+                         double *metric, ScoreRanges &ranges);
+
+/**
+ * \ingroup spider
+ * \brief Repulsive charges of the obstacles, as parallel arrays
+ *
+ * Charge k sits on the vertical segment x[k], y[k], z0[k] <= z <= z1[k]
+ * (a point when z0[k] == z1[k]) and acts on positions whose squared distance
+ * to the segment is at most reach2[k] (+infinity for no limit).
+ */
+struct PointCharges
+{
+  const double *x;
+  const double *y;
+  const double *z0;
+  const double *z1;
+  const double *q;
+  const double *reach2;
+  uint32_t n;
+};
+
+/**
+ * \ingroup spider
+ * \brief Electrostatic potential at (px, py, pz)
+ *
+ * The target (tx, ty, tz) holds the attractive charge -q, each obstacle
+ * charge in reach a repulsive charge falling with the square of the distance.
+ */
+double Potential (double px, double py, double pz,
+                  double tx, double ty, double tz, double q,
+                  const PointCharges &charges);
+
+/**
+ * \ingroup spider
+ * \brief Potential pass of the electrostatic objective
+ *
+ * Same as DistanceRanges with metric[i] the Potential of neighbour i.
+ *
+ * \return the number of candidates
+ */
+uint32_t PotentialRanges (const double *x, const double *y, const double *z,
+                          const double *energy, uint32_t n,
+                          double tx, double ty, double tz, double q,
+                          const PointCharges &charges, double bound,
+                          double *metric, ScoreRanges &ranges);
+
+/**
+ * \ingroup spider
+ * \brief Scoring pass of the lambda-weighted objective
+ *
+ * Replaces metric[i], as written by one of the range passes, with
+ * lamda * normMetric + (1 - lamda) * -normEnergy for candidates and with
+ * +infinity for the others. A term whose range collapsed contributes 0.
+ *
+ * \return the lowest objective, +infinity if there is no candidate
+ */
+double LambdaObjective (double *metric, const double *energy, uint32_t n,
+                        double bound, double lamda, const ScoreRanges &ranges);
+
+}
+}
+#endif /* SPIDER_KERNELS_H */
@@ -0,0 +1,168 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/****************************************************************************/
+/* This file is part of SPIDER project.                                       */
+/*                                                                          */
+/* SPIDER is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by     */
+/* the Free Software Foundation, either version 3 of the License, or        */
+/* (at your option) any later version.                                      */
+/*                                                                          */
+/* SPIDER is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of           */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
+/* GNU General Public License for more details.                             */
+/*                                                                          */
+/* You should have received a copy of the GNU General Public License        */
+/* along with SPIDER.  If not, see <http://www.gnu.org/licenses/>.            */
+/*                                                                          */
+/****************************************************************************/
+/*                                                                          */
+/*  Author:    Dmitrii Chemodanov, University of Missouri-Columbia          */
+/*  Title:     SPIDER: AI-augmented Geographic Routing Approach for IoT-based */
+/*             Incident-Supporting Applications                             */
+/*  Revision:  1.0         6/19/2017                                        */
+/****************************************************************************/
+#ifndef SPIDER_OBSTACLES_H
+#define SPIDER_OBSTACLES_H
+
+#include "spider-kernels.h"
+#include "ns3/simple-ref-count.h"
+#include "ns3/ptr.h"
+#include "ns3/vector.h"
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace spider {
+
+/**
+ * \ingroup spider
+ * \brief Charges of the obstacles near a neighbourhood, see ObstacleSet::Gather
+ */
+class ChargeList
+{
+public:
+  /// Removes all charges
+  void Clear ();
+  /// Returns the number of charges
+  uint32_t GetN () const
+  {
+    return m_q.size ();
+  }
+  /// Returns the charges in the layout the potential kernels expect
+  PointCharges Get () const;
+
+private:
+  friend class ObstacleSet;
+  std::vector<double> m_x;
+  std::vector<double> m_y;
+  std::vector<double> m_z0;
+  std::vector<double> m_z1;
+  std::vector<double> m_q;
+  std::vector<double> m_reach2;
+};
+
+/**
+ * \ingroup spider
+ * \brief Obstacles repelling electrostatic forwarding
+ *
+ * Every obstacle is reduced to a vertical segment (x, y, zMin..zMax) and a
+ * radius:
+ *  - a circle is a hole in the z = 0 plane;
+ *  - a cylinder spans zMin..zMax;
+ *  - a polygon in the z = 0 plane is charged as its circumscribed circle
+ *    around the area centroid.
+ *
+ * The charge of an obstacle depends on its distance to the destination and is
+ * computed once per destination. With an influence radius, an obstacle only
+ * acts on positions within radius + influence of its segment and the
+ * obstacles are kept in a uniform grid, so that gathering the obstacles of a
+ * neighbourhood costs in the number of nearby obstacles only.
+ *
+ * Obstacle files hold one obstacle per line, '#' starts a comment:
+ * \verbatim
+   circle <x> <y> <radius>
+   cylinder <x> <y> <radius> <zMin> <zMax>
+   polygon <x1> <y1> <x2> <y2> <x3> <y3> ...
+   \endverbatim
+ */
+class ObstacleSet : public SimpleRefCount<ObstacleSet>
+{
+public:
+  ObstacleSet ();
+
+  /**
+   * \brief Returns the obstacles of a file, loading it on first use
+   *
+   * Protocol instances that use the same file and influence radius share the
+   * returned set.
+   */
+  static Ptr<ObstacleSet> Load (std::string filename, double influence);
+
+  /// Reads the obstacles of filename, aborts on a malformed file
+  void ReadFile (std::string filename);
+
+  void AddCircle (double x, double y, double radius);
+  void AddCylinder (double x, double y, double radius, double zMin, double zMax);
+  /// Adds a polygon given by its vertices in the z = 0 plane
+  void AddPolygon (const std::vector<Vector> &vertices);
+
+  /// Sets how far beyond its radius an obstacle acts, 0 for no limit
+  void SetInfluenceRadius (double influence);
+
+  /// Returns the number of obstacles
+  uint32_t GetN () const
+  {
+    return m_x.size ();
+  }
+
+  /**
+   * \brief Collects the obstacles acting inside a box
+   * \param minX,minY,maxX,maxY the box (in the xy plane) holding the positions to score
+   * \param dst the position of the destination, the charges depend on it
+   * \param q the charge of the destination
+   * \param charges receives the charges of the obstacles in reach of the box
+   */
+  void Gather (double minX, double minY, double maxX, double maxY, Vector dst, double q,
+               ChargeList &charges);
+
+private:
+  void Add (double x, double y, double radius, double zMin, double zMax);
+  /// Distributes the obstacles over the grid cells their influence reaches
+  void BuildIndex ();
+  /// Charge of obstacle i for the current destination
+  double GetCharge (uint32_t i);
+  /// Appends obstacle i to charges if it reaches the box
+  void Collect (uint32_t i, double minX, double minY, double maxX, double maxY, ChargeList &charges);
+
+  // obstacles as parallel arrays
+  std::vector<double> m_x;
+  std::vector<double> m_y;
+  std::vector<double> m_zMin;
+  std::vector<double> m_zMax;
+  std::vector<double> m_radius;
+  double m_influence;
+
+  // charges, valid for m_dst and m_q where m_chargeStamp matches m_stamp
+  std::vector<double> m_charge;
+  std::vector<uint32_t> m_chargeStamp;
+  Vector m_dst;
+  double m_q;
+  uint32_t m_stamp;
+
+  // uniform grid over the xy plane; each cell lists the obstacles reaching it
+  bool m_indexValid;
+  double m_originX;
+  double m_originY;
+  double m_cellSize;
+  int32_t m_nx;
+  int32_t m_ny;
+  std::vector<std::vector<uint32_t> > m_cells;
+  // dedup of obstacles listed in several cells of one Gather
+  std::vector<uint32_t> m_seen;
+  uint32_t m_query;
+};
+
+}
+}
+#endif /* SPIDER_OBSTACLES_H */
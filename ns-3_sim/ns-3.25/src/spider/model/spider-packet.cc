@@ -26,12 +26,127 @@
 #include "ns3/address-utils.h"
 #include "ns3/packet.h"
 #include "ns3/log.h"
+#include "ns3/abort.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 NS_LOG_COMPONENT_DEFINE ("SpiderPacket");
 
 namespace ns3 {
 namespace spider {
 
+/// Version written in the high nibble of the first byte of HELLO and POS headers
+static const uint8_t HEADER_VERSION = 1;
+/// POS header flag set while the packet is in recovery mode
+static const uint8_t POS_FLAG_INREC = 0x01;
+/// POS header flag set when the sender address (and position) is carried
+static const uint8_t POS_FLAG_SENDER = 0x02;
+/// Resolution of the fixed-point coordinates, in meters
+static const double COORD_RESOLUTION = 0.01;
+/// Resolution of the fixed-point velocities, in m/s
+static const double VELOCITY_RESOLUTION = 0.01;
+/// Resolution of the HELLO hold time, in seconds
+static const double HOLD_RESOLUTION = 0.01;
+
+static Vector g_coordinateOrigin = Vector (0, 0, 0);
+
+void
+SetCoordinateOrigin (Vector origin)
+{
+  g_coordinateOrigin = origin;
+}
+
+Vector
+GetCoordinateOrigin ()
+{
+  return g_coordinateOrigin;
+}
+
+/// One coordinate as a signed offset from origin, saturating out of range values
+static int32_t
+QuantizeCoordinate (double value, double origin)
+{
+  double q = std::floor ((value - origin) / COORD_RESOLUTION + 0.5);
+  q = std::max (q, (double) std::numeric_limits<int32_t>::min ());
+  q = std::min (q, (double) std::numeric_limits<int32_t>::max ());
+  return (int32_t) q;
+}
+
+static void
+WriteCoordinate (Buffer::Iterator &i, double value, double origin)
+{
+  i.WriteHtonU32 ((uint32_t) QuantizeCoordinate (value, origin));
+}
+
+static double
+ReadCoordinate (Buffer::Iterator &i, double origin)
+{
+  return origin + (int32_t) i.ReadNtohU32 () * COORD_RESOLUTION;
+}
+
+static void
+WritePosition (Buffer::Iterator &i, double x, double y, double z)
+{
+  WriteCoordinate (i, x, g_coordinateOrigin.x);
+  WriteCoordinate (i, y, g_coordinateOrigin.y);
+  WriteCoordinate (i, z, g_coordinateOrigin.z);
+}
+
+/// Returns true if both positions are written as the same bytes
+static bool
+SamePosition (double x1, double y1, double z1, double x2, double y2, double z2)
+{
+  return QuantizeCoordinate (x1, g_coordinateOrigin.x) == QuantizeCoordinate (x2, g_coordinateOrigin.x)
+         && QuantizeCoordinate (y1, g_coordinateOrigin.y) == QuantizeCoordinate (y2, g_coordinateOrigin.y)
+         && QuantizeCoordinate (z1, g_coordinateOrigin.z) == QuantizeCoordinate (z2, g_coordinateOrigin.z);
+}
+
+static void
+ReadPosition (Buffer::Iterator &i, double &x, double &y, double &z)
+{
+  x = ReadCoordinate (i, g_coordinateOrigin.x);
+  y = ReadCoordinate (i, g_coordinateOrigin.y);
+  z = ReadCoordinate (i, g_coordinateOrigin.z);
+}
+
+static void
+WriteVelocityComponent (Buffer::Iterator &i, double value)
+{
+  double q = std::floor (value / VELOCITY_RESOLUTION + 0.5);
+  q = std::max (q, (double) std::numeric_limits<int16_t>::min ());
+  q = std::min (q, (double) std::numeric_limits<int16_t>::max ());
+  i.WriteHtonU16 ((uint16_t)(int16_t) q);
+}
+
+static void
+WriteVelocity (Buffer::Iterator &i, Vector v)
+{
+  WriteVelocityComponent (i, v.x);
+  WriteVelocityComponent (i, v.y);
+  WriteVelocityComponent (i, v.z);
+}
+
+static Vector
+ReadVelocity (Buffer::Iterator &i)
+{
+  Vector v;
+  v.x = (int16_t) i.ReadNtohU16 () * VELOCITY_RESOLUTION;
+  v.y = (int16_t) i.ReadNtohU16 () * VELOCITY_RESOLUTION;
+  v.z = (int16_t) i.ReadNtohU16 () * VELOCITY_RESOLUTION;
+  return v;
+}
+
+/// Reads the version/flags byte and checks the version, returns the flags
+static uint8_t
+ReadVersion (Buffer::Iterator &i)
+{
+  uint8_t b = i.ReadU8 ();
+  NS_ABORT_MSG_UNLESS ((b >> 4) == HEADER_VERSION,
+                       "Unsupported SPIDER header version " << (uint32_t)(b >> 4));
+  return b & 0x0f;
+}
+
 NS_OBJECT_ENSURE_REGISTERED (TypeHeader);
 
 TypeHeader::TypeHeader (MessageType t = SPIDERTYPE_HELLO)
@@ -126,9 +241,12 @@ operator<< (std::ostream & os, TypeHeader const & h)
 //-----------------------------------------------------------------------------
 // HELLO
 //-----------------------------------------------------------------------------
-HelloHeader::HelloHeader (uint64_t originPosx, uint64_t originPosy)
+HelloHeader::HelloHeader (double originPosx, double originPosy, double originPosz)
   : m_originPosx (originPosx),
-    m_originPosy (originPosy)
+    m_originPosy (originPosy),
+    m_originPosz (originPosz),
+    m_velocity (Vector (0, 0, 0)),
+    m_holdTime (Seconds (0))
 {
 }
 
@@ -153,18 +271,19 @@ HelloHeader::GetInstanceTypeId () const
 uint32_t
 HelloHeader::GetSerializedSize () const
 {
-  return 16;
+  return 21;
 }
 
 void
 HelloHeader::Serialize (Buffer::Iterator i) const
 {
-  NS_LOG_DEBUG ("Serialize X " << m_originPosx << " Y " << m_originPosy);
-
-
-  i.WriteHtonU64 (m_originPosx);
-  i.WriteHtonU64 (m_originPosy);
+  NS_LOG_DEBUG ("Serialize X " << m_originPosx << " Y " << m_originPosy << " Z " << m_originPosz);
 
+  i.WriteU8 (HEADER_VERSION << 4);
+  WritePosition (i, m_originPosx, m_originPosy, m_originPosz);
+  WriteVelocity (i, m_velocity);
+  double hold = std::ceil (m_holdTime.GetSeconds () / HOLD_RESOLUTION);
+  i.WriteHtonU16 ((uint16_t) std::max (0.0, std::min (hold, (double) std::numeric_limits<uint16_t>::max ())));
 }
 
 uint32_t
@@ -173,10 +292,12 @@ HelloHeader::Deserialize (Buffer::Iterator start)
 
   Buffer::Iterator i = start;
 
-  m_originPosx = i.ReadNtohU64 ();
-  m_originPosy = i.ReadNtohU64 ();
+  ReadVersion (i);
+  ReadPosition (i, m_originPosx, m_originPosy, m_originPosz);
+  m_velocity = ReadVelocity (i);
+  m_holdTime = Seconds (i.ReadNtohU16 () * HOLD_RESOLUTION);
 
-  NS_LOG_DEBUG ("Deserialize X " << m_originPosx << " Y " << m_originPosy);
+  NS_LOG_DEBUG ("Deserialize X " << m_originPosx << " Y " << m_originPosy << " Z " << m_originPosz);
 
   uint32_t dist = i.GetDistanceFrom (start);
   NS_ASSERT (dist == GetSerializedSize ());
@@ -187,7 +308,10 @@ void
 HelloHeader::Print (std::ostream &os) const
 {
   os << " PositionX: " << m_originPosx
-     << " PositionY: " << m_originPosy;
+     << " PositionY: " << m_originPosy
+     << " PositionZ: " << m_originPosz
+     << " Velocity: " << m_velocity
+     << " HoldTime: " << m_holdTime.GetSeconds ();
 }
 
 std::ostream &
@@ -202,7 +326,9 @@ operator<< (std::ostream & os, HelloHeader const & h)
 bool
 HelloHeader::operator== (HelloHeader const & o) const
 {
-  return (m_originPosx == o.m_originPosx && m_originPosy == o.m_originPosy);
+  return (m_originPosx == o.m_originPosx && m_originPosy == o.m_originPosy && m_originPosz == o.m_originPosz
+          && m_velocity.x == o.m_velocity.x && m_velocity.y == o.m_velocity.y && m_velocity.z == o.m_velocity.z
+          && m_holdTime == o.m_holdTime);
 }
 
 
@@ -212,15 +338,43 @@ HelloHeader::operator== (HelloHeader const & o) const
 //-----------------------------------------------------------------------------
 // Position
 //-----------------------------------------------------------------------------
-PositionHeader::PositionHeader (uint64_t dstPosx, uint64_t dstPosy, uint32_t updated, uint64_t recPosx, uint64_t recPosy, uint8_t inRec, uint64_t lastPosx, uint64_t lastPosy)
+PositionHeader::PositionHeader (double dstPosx, double dstPosy, uint32_t updated, double recPosx, double recPosy, uint8_t inRec, double lastPosx, double lastPosy)
   : m_dstPosx (dstPosx),
     m_dstPosy (dstPosy),
+    m_dstPosz (0),
     m_updated (updated),
     m_recPosx (recPosx),
     m_recPosy (recPosy),
+    m_recPosz (0),
     m_inRec (inRec),
     m_lastPosx (lastPosx),
-    m_lastPosy (lastPosy)
+    m_lastPosy (lastPosy),
+    m_lastPosz (0),
+    m_sender (Ipv4Address::GetZero ()),
+    m_faceEntry (recPosx, recPosy, 0),
+    m_firstFrom (Ipv4Address::GetZero ()),
+    m_firstTo (Ipv4Address::GetZero ()),
+    m_faceChanges (0)
+{
+}
+
+PositionHeader::PositionHeader (Vector dstPos, uint32_t updated, Vector recPos, uint8_t inRec, Vector lastPos)
+  : m_dstPosx (dstPos.x),
+    m_dstPosy (dstPos.y),
+    m_dstPosz (dstPos.z),
+    m_updated (updated),
+    m_recPosx (recPos.x),
+    m_recPosy (recPos.y),
+    m_recPosz (recPos.z),
+    m_inRec (inRec),
+    m_lastPosx (lastPos.x),
+    m_lastPosy (lastPos.y),
+    m_lastPosz (lastPos.z),
+    m_sender (Ipv4Address::GetZero ()),
+    m_faceEntry (recPos),
+    m_firstFrom (Ipv4Address::GetZero ()),
+    m_firstTo (Ipv4Address::GetZero ()),
+    m_faceChanges (0)
 {
 }
 
@@ -245,34 +399,78 @@ PositionHeader::GetInstanceTypeId () const
 uint32_t
 PositionHeader::GetSerializedSize () const
 {
-  return 53;
+  uint32_t size = 17;
+  if (m_inRec)
+    {
+      size += 12 + 12 + 4 + 4 + 1;
+    }
+  if (m_inRec || HasSender ())
+    {
+      size += 12;
+    }
+  if (HasSender ())
+    {
+      size += 4;
+    }
+  return size;
 }
 
 void
 PositionHeader::Serialize (Buffer::Iterator i) const
 {
-  i.WriteU64 (m_dstPosx);
-  i.WriteU64 (m_dstPosy);
-  i.WriteU32 (m_updated);
-  i.WriteU64 (m_recPosx);
-  i.WriteU64 (m_recPosy);
-  i.WriteU8 (m_inRec);
-  i.WriteU64 (m_lastPosx);
-  i.WriteU64 (m_lastPosy);
+  i.WriteU8 ((HEADER_VERSION << 4) | (m_inRec ? POS_FLAG_INREC : 0)
+             | (HasSender () ? POS_FLAG_SENDER : 0));
+  WritePosition (i, m_dstPosx, m_dstPosy, m_dstPosz);
+  i.WriteHtonU32 (m_updated);
+  if (m_inRec)
+    {
+      WritePosition (i, m_recPosx, m_recPosy, m_recPosz);
+      WritePosition (i, m_faceEntry.x, m_faceEntry.y, m_faceEntry.z);
+      WriteTo (i, m_firstFrom);
+      WriteTo (i, m_firstTo);
+      i.WriteU8 (m_faceChanges);
+    }
+  if (m_inRec || HasSender ())
+    {
+      WritePosition (i, m_lastPosx, m_lastPosy, m_lastPosz);
+    }
+  if (HasSender ())
+    {
+      WriteTo (i, m_sender);
+    }
 }
 
 uint32_t
 PositionHeader::Deserialize (Buffer::Iterator start)
 {
   Buffer::Iterator i = start;
-  m_dstPosx = i.ReadU64 ();
-  m_dstPosy = i.ReadU64 ();
-  m_updated = i.ReadU32 ();
-  m_recPosx = i.ReadU64 ();
-  m_recPosy = i.ReadU64 ();
-  m_inRec = i.ReadU8 ();
-  m_lastPosx = i.ReadU64 ();
-  m_lastPosy = i.ReadU64 ();
+  uint8_t flags = ReadVersion (i);
+  ReadPosition (i, m_dstPosx, m_dstPosy, m_dstPosz);
+  m_updated = i.ReadNtohU32 ();
+  m_inRec = (flags & POS_FLAG_INREC) ? 1 : 0;
+  bool hasSender = (flags & POS_FLAG_SENDER) != 0;
+  m_recPosx = m_recPosy = m_recPosz = 0;
+  m_lastPosx = m_lastPosy = m_lastPosz = 0;
+  m_sender = Ipv4Address::GetZero ();
+  m_faceEntry = Vector ();
+  m_firstFrom = m_firstTo = Ipv4Address::GetZero ();
+  m_faceChanges = 0;
+  if (m_inRec)
+    {
+      ReadPosition (i, m_recPosx, m_recPosy, m_recPosz);
+      ReadPosition (i, m_faceEntry.x, m_faceEntry.y, m_faceEntry.z);
+      ReadFrom (i, m_firstFrom);
+      ReadFrom (i, m_firstTo);
+      m_faceChanges = i.ReadU8 ();
+    }
+  if (m_inRec || hasSender)
+    {
+      ReadPosition (i, m_lastPosx, m_lastPosy, m_lastPosz);
+    }
+  if (hasSender)
+    {
+      ReadFrom (i, m_sender);
+    }
 
   uint32_t dist = i.GetDistanceFrom (start);
   NS_ASSERT (dist == GetSerializedSize ());
@@ -284,12 +482,19 @@ PositionHeader::Print (std::ostream &os) const
 {
   os << " PositionX: "  << m_dstPosx
      << " PositionY: " << m_dstPosy
+     << " PositionZ: " << m_dstPosz
      << " Updated: " << m_updated
      << " RecPositionX: " << m_recPosx
      << " RecPositionY: " << m_recPosy
-     << " inRec: " << m_inRec
+     << " RecPositionZ: " << m_recPosz
+     << " inRec: " << (uint32_t) m_inRec
      << " LastPositionX: " << m_lastPosx
-     << " LastPositionY: " << m_lastPosy;
+     << " LastPositionY: " << m_lastPosy
+     << " LastPositionZ: " << m_lastPosz
+     << " Sender: " << m_sender
+     << " FaceEntry: " << m_faceEntry
+     << " FirstEdge: " << m_firstFrom << "->" << m_firstTo
+     << " FaceChanges: " << (uint32_t) m_faceChanges;
 }
 
 std::ostream &
@@ -304,7 +509,178 @@ operator<< (std::ostream & os, PositionHeader const & h)
 bool
 PositionHeader::operator== (PositionHeader const & o) const
 {
-  return (m_dstPosx == o.m_dstPosx && m_dstPosy == m_dstPosy && m_updated == o.m_updated && m_recPosx == o.m_recPosx && m_recPosy == o.m_recPosy && m_inRec == o.m_inRec && m_lastPosx == o.m_lastPosx && m_lastPosy == o.m_lastPosy);
+  return (m_dstPosx == o.m_dstPosx && m_dstPosy == o.m_dstPosy && m_dstPosz == o.m_dstPosz && m_updated == o.m_updated
+          && m_recPosx == o.m_recPosx && m_recPosy == o.m_recPosy && m_recPosz == o.m_recPosz && m_inRec == o.m_inRec
+          && m_lastPosx == o.m_lastPosx && m_lastPosy == o.m_lastPosy && m_lastPosz == o.m_lastPosz
+          && m_sender == o.m_sender && m_faceEntry.x == o.m_faceEntry.x && m_faceEntry.y == o.m_faceEntry.y
+          && m_faceEntry.z == o.m_faceEntry.z && m_firstFrom == o.m_firstFrom && m_firstTo == o.m_firstTo
+          && m_faceChanges == o.m_faceChanges);
+}
+
+bool
+PositionHeader::SameOnWire (PositionHeader const & o) const
+{
+  if (m_updated != o.m_updated || (m_inRec != 0) != (o.m_inRec != 0) || m_sender != o.m_sender
+      || !SamePosition (m_dstPosx, m_dstPosy, m_dstPosz, o.m_dstPosx, o.m_dstPosy, o.m_dstPosz))
+    {
+      return false;
+    }
+  if (m_inRec && (!SamePosition (m_recPosx, m_recPosy, m_recPosz, o.m_recPosx, o.m_recPosy, o.m_recPosz)
+                  || !SamePosition (m_faceEntry.x, m_faceEntry.y, m_faceEntry.z,
+                                    o.m_faceEntry.x, o.m_faceEntry.y, o.m_faceEntry.z)
+                  || m_firstFrom != o.m_firstFrom || m_firstTo != o.m_firstTo
+                  || m_faceChanges != o.m_faceChanges))
+    {
+      return false;
+    }
+  if ((m_inRec || HasSender ())
+      && !SamePosition (m_lastPosx, m_lastPosy, m_lastPosz, o.m_lastPosx, o.m_lastPosy, o.m_lastPosz))
+    {
+      return false;
+    }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// DATA
+//-----------------------------------------------------------------------------
+DataHeader::DataHeader (PositionHeader const &position)
+  : m_type (SPIDERTYPE_POS),
+    m_position (position)
+{
+}
+
+NS_OBJECT_ENSURE_REGISTERED (DataHeader);
+
+TypeId
+DataHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::spider::DataHeader")
+    .SetParent<Header> ()
+    .AddConstructor<DataHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+DataHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+DataHeader::GetSerializedSize () const
+{
+  if (!IsValid ())
+    {
+      return m_type.GetSerializedSize ();
+    }
+  return m_type.GetSerializedSize () + m_position.GetSerializedSize ();
+}
+
+void
+DataHeader::Serialize (Buffer::Iterator i) const
+{
+  m_type.Serialize (i);
+  if (IsValid ())
+    {
+      i.Next (m_type.GetSerializedSize ());
+      m_position.Serialize (i);
+    }
+}
+
+uint32_t
+DataHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  i.Next (m_type.Deserialize (i));
+  if (IsValid ())
+    {
+      i.Next (m_position.Deserialize (i));
+    }
+  return i.GetDistanceFrom (start);
+}
+
+void
+DataHeader::Print (std::ostream &os) const
+{
+  m_type.Print (os);
+  if (IsValid ())
+    {
+      m_position.Print (os);
+    }
+}
+
+void
+DataHeader::Rewrite (Ptr<Packet> p, PositionHeader const &position)
+{
+  if (IsValid () && m_position.SameOnWire (position))
+    {
+      return;
+    }
+  p->RemoveAtStart (GetSerializedSize ());
+  m_type = TypeHeader (SPIDERTYPE_POS);
+  m_position = position;
+  p->AddHeader (*this);
+}
+
+std::ostream &
+operator<< (std::ostream & os, DataHeader const & h)
+{
+  h.Print (os);
+  return os;
+}
+
+//-----------------------------------------------------------------------------
+// SUBFRAME
+//-----------------------------------------------------------------------------
+SubframeHeader::SubframeHeader (uint16_t length)
+  : m_length (length)
+{
+}
+
+NS_OBJECT_ENSURE_REGISTERED (SubframeHeader);
+
+TypeId
+SubframeHeader::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::spider::SubframeHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SubframeHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+SubframeHeader::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+SubframeHeader::GetSerializedSize () const
+{
+  return 2;
+}
+
+void
+SubframeHeader::Serialize (Buffer::Iterator i) const
+{
+  i.WriteHtonU16 (m_length);
+}
+
+uint32_t
+SubframeHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  m_length = i.ReadNtohU16 ();
+  return i.GetDistanceFrom (start);
+}
+
+void
+SubframeHeader::Print (std::ostream &os) const
+{
+  os << "Subframe length: " << m_length;
 }
 
 
@@ -32,6 +32,7 @@
 #include <map>
 #include "ns3/nstime.h"
 #include "ns3/vector.h"
+#include "ns3/packet.h"
 
 namespace ns3 {
 namespace spider {
@@ -82,11 +83,32 @@ private:
 
 std::ostream & operator<< (std::ostream & os, TypeHeader const & h);
 
+/**
+ * \brief Sets the scenario origin the header coordinates are encoded against
+ *
+ * Positions travel as signed fixed-point offsets from this origin (1 cm
+ * resolution, 32 bits per axis), so every node of a scenario must use the
+ * same origin. Defaults to (0,0,0).
+ */
+void SetCoordinateOrigin (Vector origin);
+/// Returns the scenario origin, see SetCoordinateOrigin
+Vector GetCoordinateOrigin ();
+
+/**
+ * \ingroup spider
+ * \brief Periodic beacon carrying the position and velocity of its originator
+ *
+ * Version 1 layout (21 bytes): a version byte, the x, y and z coordinates
+ * in the fixed-point encoding of SetCoordinateOrigin, the velocity as
+ * signed 16-bit cm/s per axis (+/-327 m/s, saturating) and the hold time,
+ * how long receivers keep the originator as a neighbour without a new
+ * HELLO, in 10 ms units (up to 655 s, saturating).
+ */
 class HelloHeader : public Header
 {
 public:
   /// c-tor
-  HelloHeader (uint64_t originPosx = 0, uint64_t originPosy = 0);
+  HelloHeader (double originPosx = 0, double originPosy = 0, double originPosz = 0);
 
   ///\name Header serialization/deserialization
   //\{
@@ -100,38 +122,91 @@ public:
 
   ///\name Fields
   //\{
-  void SetOriginPosx (uint64_t posx)
+  void SetOriginPosx (double posx)
   {
     m_originPosx = posx;
   }
-  uint64_t GetOriginPosx () const
+  double GetOriginPosx () const
   {
     return m_originPosx;
   }
-  void SetOriginPosy (uint64_t posy)
+  void SetOriginPosy (double posy)
   {
     m_originPosy = posy;
   }
-  uint64_t GetOriginPosy () const
+  double GetOriginPosy () const
   {
     return m_originPosy;
   }
+  void SetOriginPosz (double posz)
+  {
+    m_originPosz = posz;
+  }
+  double GetOriginPosz () const
+  {
+    return m_originPosz;
+  }
+  void SetVelocity (Vector velocity)
+  {
+    m_velocity = velocity;
+  }
+  Vector GetVelocity () const
+  {
+    return m_velocity;
+  }
+  void SetHoldTime (Time hold)
+  {
+    m_holdTime = hold;
+  }
+  Time GetHoldTime () const
+  {
+    return m_holdTime;
+  }
+  void SetOriginPos (Vector pos)
+  {
+    m_originPosx = pos.x;
+    m_originPosy = pos.y;
+    m_originPosz = pos.z;
+  }
+  Vector GetOriginPos () const
+  {
+    return Vector (m_originPosx, m_originPosy, m_originPosz);
+  }
   //\}
 
 
   bool operator== (HelloHeader const & o) const;
 private:
-  uint64_t         m_originPosx;          ///< Originator Position x
-  uint64_t         m_originPosy;          ///< Originator Position x
+  double           m_originPosx;          ///< Originator Position x
+  double           m_originPosy;          ///< Originator Position y
+  double           m_originPosz;          ///< Originator Position z
+  Vector           m_velocity;            ///< Originator velocity
+  Time             m_holdTime;            ///< Neighbour validity advertised by the originator
 };
 
 std::ostream & operator<< (std::ostream & os, HelloHeader const &);
 
+/**
+ * \ingroup spider
+ * \brief Geographic routing header of data packets
+ *
+ * Version 1 layout: a version/flags byte, the destination position and the
+ * update time of that position (17 bytes). The recovery position is only
+ * carried while the packet is in recovery mode (12 more bytes), the previous
+ * hop position in recovery mode or when the sender address is set (12 more
+ * bytes), the sender address only when set (4 more bytes). Absent fields
+ * read as zero.
+ *
+ * The sender address lets receivers, and nodes overhearing the frame,
+ * refresh the neighbour entry of the previous hop from its position.
+ */
 class PositionHeader : public Header
 {
 public:
   /// c-tor
-  PositionHeader (uint64_t dstPosx = 0, uint64_t dstPosy = 0, uint32_t updated = 0, uint64_t recPosx = 0, uint64_t recPosy = 0, uint8_t inRec  = 0, uint64_t lastPosx = 0, uint64_t lastPosy = 0);
+  PositionHeader (double dstPosx = 0, double dstPosy = 0, uint32_t updated = 0, double recPosx = 0, double recPosy = 0, uint8_t inRec  = 0, double lastPosx = 0, double lastPosy = 0);
+  /// c-tor taking full 3D positions
+  PositionHeader (Vector dstPos, uint32_t updated, Vector recPos, uint8_t inRec, Vector lastPos);
 
   ///\name Header serialization/deserialization
   //\{
@@ -145,22 +220,40 @@ public:
 
   ///\name Fields
   //\{
-  void SetDstPosx (uint64_t posx)
+  void SetDstPosx (double posx)
   {
     m_dstPosx = posx;
   }
-  uint64_t GetDstPosx () const
+  double GetDstPosx () const
   {
     return m_dstPosx;
   }
-  void SetDstPosy (uint64_t posy)
+  void SetDstPosy (double posy)
   {
     m_dstPosy = posy;
   }
-  uint64_t GetDstPosy () const
+  double GetDstPosy () const
   {
     return m_dstPosy;
   }
+  void SetDstPosz (double posz)
+  {
+    m_dstPosz = posz;
+  }
+  double GetDstPosz () const
+  {
+    return m_dstPosz;
+  }
+  void SetDstPos (Vector pos)
+  {
+    m_dstPosx = pos.x;
+    m_dstPosy = pos.y;
+    m_dstPosz = pos.z;
+  }
+  Vector GetDstPos () const
+  {
+    return Vector (m_dstPosx, m_dstPosy, m_dstPosz);
+  }
   void SetUpdated (uint32_t updated)
   {
     m_updated = updated;
@@ -169,22 +262,40 @@ public:
   {
     return m_updated;
   }
-  void SetRecPosx (uint64_t posx)
+  void SetRecPosx (double posx)
   {
     m_recPosx = posx;
   }
-  uint64_t GetRecPosx () const
+  double GetRecPosx () const
   {
     return m_recPosx;
   }
-  void SetRecPosy (uint64_t posy)
+  void SetRecPosy (double posy)
   {
     m_recPosy = posy;
   }
-  uint64_t GetRecPosy () const
+  double GetRecPosy () const
   {
     return m_recPosy;
   }
+  void SetRecPosz (double posz)
+  {
+    m_recPosz = posz;
+  }
+  double GetRecPosz () const
+  {
+    return m_recPosz;
+  }
+  void SetRecPos (Vector pos)
+  {
+    m_recPosx = pos.x;
+    m_recPosy = pos.y;
+    m_recPosz = pos.z;
+  }
+  Vector GetRecPos () const
+  {
+    return Vector (m_recPosx, m_recPosy, m_recPosz);
+  }
   void SetInRec (uint8_t rec)
   {
     m_inRec = rec;
@@ -193,41 +304,204 @@ public:
   {
     return m_inRec;
   }
-  void SetLastPosx (uint64_t posx)
+  void SetLastPosx (double posx)
   {
     m_lastPosx = posx;
   }
-  uint64_t GetLastPosx () const
+  double GetLastPosx () const
   {
     return m_lastPosx;
   }
-  void SetLastPosy (uint64_t posy)
+  void SetLastPosy (double posy)
   {
     m_lastPosy = posy;
   }
-  uint64_t GetLastPosy () const
+  double GetLastPosy () const
   {
     return m_lastPosy;
   }
+  void SetLastPosz (double posz)
+  {
+    m_lastPosz = posz;
+  }
+  double GetLastPosz () const
+  {
+    return m_lastPosz;
+  }
+  /// Sets the address of the previous hop, carried with its position (last position)
+  void SetSender (Ipv4Address sender)
+  {
+    m_sender = sender;
+  }
+  /// Returns the address of the previous hop, Ipv4Address::GetZero () if not carried
+  Ipv4Address GetSender () const
+  {
+    return m_sender;
+  }
+  bool HasSender () const
+  {
+    return m_sender != Ipv4Address::GetZero ();
+  }
+  void SetLastPos (Vector pos)
+  {
+    m_lastPosx = pos.x;
+    m_lastPosy = pos.y;
+    m_lastPosz = pos.z;
+  }
+  Vector GetLastPos () const
+  {
+    return Vector (m_lastPosx, m_lastPosy, m_lastPosz);
+  }
+  /// Sets the point the current face was entered at, and forgets its first edge
+  void SetFaceEntry (Vector pos)
+  {
+    m_faceEntry = pos;
+    m_firstFrom = Ipv4Address::GetZero ();
+    m_firstTo = Ipv4Address::GetZero ();
+  }
+  Vector GetFaceEntry () const
+  {
+    return m_faceEntry;
+  }
+  /// Sets the first edge taken on the current face, from the address of the node that took it to its next hop
+  void SetFirstEdge (Ipv4Address from, Ipv4Address to)
+  {
+    m_firstFrom = from;
+    m_firstTo = to;
+  }
+  Ipv4Address GetFirstEdgeFrom () const
+  {
+    return m_firstFrom;
+  }
+  Ipv4Address GetFirstEdgeTo () const
+  {
+    return m_firstTo;
+  }
+  bool HasFirstEdge () const
+  {
+    return m_firstFrom != Ipv4Address::GetZero ();
+  }
+  /// Returns true if from -> to is the first edge of the current face, the face was walked around
+  bool IsFirstEdge (Ipv4Address from, Ipv4Address to) const
+  {
+    return HasFirstEdge () && m_firstFrom == from && m_firstTo == to;
+  }
+  void SetFaceChanges (uint8_t changes)
+  {
+    m_faceChanges = changes;
+  }
+  uint8_t GetFaceChanges () const
+  {
+    return m_faceChanges;
+  }
+  //\}
 
 
   bool operator== (PositionHeader const & o) const;
+  /// Returns true if both headers serialize to the same bytes
+  bool SameOnWire (PositionHeader const & o) const;
 private:
-  uint64_t         m_dstPosx;          ///< Destination Position x
-  uint64_t         m_dstPosy;          ///< Destination Position x
+  double           m_dstPosx;          ///< Destination Position x
+  double           m_dstPosy;          ///< Destination Position y
+  double           m_dstPosz;          ///< Destination Position z
   uint32_t         m_updated;          ///< Time of last update
-  uint64_t         m_recPosx;          ///< x of position that entered Recovery-mode
-  uint64_t         m_recPosy;          ///< y of position that entered Recovery-mode
+  double           m_recPosx;          ///< x of position that entered Recovery-mode
+  double           m_recPosy;          ///< y of position that entered Recovery-mode
+  double           m_recPosz;          ///< z of position that entered Recovery-mode
   uint8_t          m_inRec;          ///< 1 if in Recovery-mode, 0 otherwise
-  uint64_t         m_lastPosx;          ///< x of position of previous hop
-  uint64_t         m_lastPosy;          ///< y of position of previous hop
-  //uint64_t         m_firstFacePosx;          ///< x of position of the first visited hop along face [need to terminate recovery]
-  //uint64_t         m_firstFacePosy;          ///< y of position of previous hop
+  double           m_lastPosx;          ///< x of position of previous hop
+  double           m_lastPosy;          ///< y of position of previous hop
+  double           m_lastPosz;          ///< z of position of previous hop
+  Ipv4Address      m_sender;            ///< address of previous hop, zero if not carried
+  Vector           m_faceEntry;         ///< point the current face was entered at, in Recovery-mode
+  Ipv4Address      m_firstFrom;         ///< node that took the first edge of the current face, zero if not taken yet
+  Ipv4Address      m_firstTo;           ///< next hop of the first edge of the current face
+  uint8_t          m_faceChanges;       ///< faces changed since entering Recovery-mode
 
 };
 
 std::ostream & operator<< (std::ostream & os, PositionHeader const &);
 
+/**
+ * \ingroup spider
+ * \brief The TypeHeader and PositionHeader of a data packet, as one header
+ *
+ * The forwarding path peeks it and rewrites the packet only when the
+ * PositionHeader of the next hop serializes differently, instead of
+ * removing and adding the two headers at every step.
+ */
+class DataHeader : public Header
+{
+public:
+  /// c-tor
+  DataHeader (PositionHeader const &position = PositionHeader ());
+
+  ///\name Header serialization/deserialization
+  //\{
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  void Print (std::ostream &os) const;
+  //\}
+
+  /// Returns false unless the type read is SPIDERTYPE_POS, only the type is read then
+  bool IsValid () const
+  {
+    return m_type.IsValid () && m_type.Get () == SPIDERTYPE_POS;
+  }
+  PositionHeader const & GetPosition () const
+  {
+    return m_position;
+  }
+
+  /**
+   * \brief Replaces this header, at the start of p, with a new PositionHeader
+   *
+   * Leaves p untouched if position serializes as the current PositionHeader,
+   * otherwise drops the current bytes and adds the new header at once.
+   */
+  void Rewrite (Ptr<Packet> p, PositionHeader const &position);
+private:
+  TypeHeader m_type;
+  PositionHeader m_position;
+};
+
+std::ostream & operator<< (std::ostream & os, DataHeader const &);
+
+/**
+ * \ingroup spider
+ * \brief Length of one packet of an aggregate frame
+ *
+ * An aggregate frame is the DataHeader its sender shares with the packets
+ * it carries, followed, for every packet, by this header (2 bytes, the
+ * length of what follows) and the packet with its IPv4 header.
+ */
+class SubframeHeader : public Header
+{
+public:
+  /// c-tor
+  SubframeHeader (uint16_t length = 0);
+
+  ///\name Header serialization/deserialization
+  //\{
+  static TypeId GetTypeId ();
+  TypeId GetInstanceTypeId () const;
+  uint32_t GetSerializedSize () const;
+  void Serialize (Buffer::Iterator start) const;
+  uint32_t Deserialize (Buffer::Iterator start);
+  void Print (std::ostream &os) const;
+  //\}
+
+  uint16_t GetLength () const
+  {
+    return m_length;
+  }
+private:
+  uint16_t m_length;
+};
+
 }
 }
 #endif /* SPIDERPACKET_H */
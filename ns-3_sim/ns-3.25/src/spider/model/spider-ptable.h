@@ -26,6 +26,9 @@
 #define _DEFINE_DEPRECATED_HASH_CLASSES 0
 #include <map>
 #include <set>
+#include <vector>
+#include <queue>
+#include <functional>
 #include <cassert>
 #include <stdint.h>
 #include "ns3/ipv4.h"
@@ -36,14 +39,21 @@
 #include "ns3/mobility-model.h"
 #include "ns3/vector.h"
 #include "ns3/wifi-mac-header.h"
+#include "ns3/arp-cache.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/node-container.h"
 #include "ns3/node.h"
+#include "ns3/basic-energy-source.h"
+#include "spider-kernels.h"
+#include "spider-obstacles.h"
 #include <complex>
 
 namespace ns3 {
 namespace spider {
 
+/// A next-hop candidate and its weight, in (0, 1], the best candidate weighing 1
+typedef std::pair<Ipv4Address, double> WeightedNeighbor;
+
 /*
  * \ingroup spider
  * \brief Position table used by SPIDER
@@ -66,11 +76,47 @@ public:
    */
   void AddEntry (Ipv4Address id, Vector position);
 
+  /**
+   * \brief Adds entry of a moving neighbour in position table
+   *
+   * The neighbour position is extrapolated from position and velocity when
+   * the table is scored. With a radio range set (see SetLifetimeModel) the
+   * entry expires once the relative motion of the two nodes is predicted to
+   * carry the neighbour out of range, and at the latest after holdTime.
+   * \param id neighbour address
+   * \param position neighbour position when the hello was sent
+   * \param velocity neighbour velocity when the hello was sent
+   * \param myPos position of this node
+   * \param myVelocity velocity of this node
+   * \param holdTime lifetime advertised by the neighbour, zero for the maximum lifetime
+   * \param iface interface the hello was received on, zero if unknown
+   */
+  void AddEntry (Ipv4Address id, Vector position, Vector velocity, Vector myPos, Vector myVelocity, Time holdTime, uint32_t iface);
+
+  /**
+   * \brief Refreshes the entry of a neighbour from a position it sent along with data
+   *
+   * Keeps the velocity and hold time of its last hello, a neighbour not in
+   * the table is added as static with the maximum lifetime.
+   */
+  void RefreshEntry (Ipv4Address id, Vector position, Vector myPos, Vector myVelocity, uint32_t iface);
+
   /**
    * \brief Deletes entry in position table
    */
   void DeleteEntry (Ipv4Address id);
 
+  /**
+   * \brief Deletes the entries of the neighbours heard on an interface
+   */
+  void DeleteInterface (uint32_t iface);
+
+  /**
+   * \brief Gets the interface a neighbour was last heard on
+   * \return the interface index, zero if id is not a neighbour or was added without one
+   */
+  uint32_t GetInterface (Ipv4Address id);
+
   /**
    * \brief Gets position from position table
    * \param id Ipv4Address to get position from
@@ -85,8 +131,22 @@ public:
    */
   bool isNeighbour (Ipv4Address id);
 
+  /**
+   * \brief Gets the position of a neighbour as the last scoring pass saw it
+   * \return the position, GetInvalidPosition () if id is not a neighbour
+   */
+  Vector GetNeighborPosition (Ipv4Address id);
+
+  /**
+   * \brief Checks if the table has no neighbour left once expired entries are purged
+   */
+  bool IsEmpty ();
+
   /**
    * \brief remove entries with expired lifetime
+   *
+   * Only pops the expiry records that are due, so the cost is proportional
+   * to the number of position updates that expired since the last call.
    */
   void Purge ();
 
@@ -103,11 +163,107 @@ public:
     return m_txErrorCallback;
   }
 
+  /**
+   * \brief Sets the callback run with the address of a neighbour the MAC failed to reach
+   *
+   * The neighbour is already out of the table when the callback runs.
+   */
+  void SetLinkFailureCallback (Callback<void, Ipv4Address> cb)
+  {
+    m_handleLinkFailure = cb;
+  }
+
+  /**
+   * \brief Sets the callback run with the address of a neighbour that joined or moved
+   *
+   * Runs whenever AddEntry changes the epoch, after the table is updated.
+   */
+  void SetNeighborUpdateCallback (Callback<void, Ipv4Address> cb)
+  {
+    m_handleNeighborUpdate = cb;
+  }
+
+  /**
+   * \brief Sets how long a neighbour the MAC failed to reach is kept out of the table
+   * \param timeout blacklist period, zero only evicts the neighbour
+   */
+  void SetBlacklistTimeout (Time timeout)
+  {
+    m_blacklistTimeout = timeout;
+  }
+
+  /// Adds an ARP cache used to map the MAC addresses of TX reports to neighbours
+  void AddArpCache (Ptr<ArpCache> a);
+  /// Removes an ARP cache added with AddArpCache
+  void DelArpCache (Ptr<ArpCache> a);
+
+  /**
+   * \brief Finds the neighbour owning a MAC address
+   * \param hwaddr MAC address of a TX report
+   * \return Ipv4Address of the neighbour, or blacklisted neighbour, Ipv4Address::GetZero () if none
+   */
+  Ipv4Address LookupNeighbor (Mac48Address hwaddr);
+
+  /**
+   * \brief Sets how long neighbour entries live without a new hello
+   * \param range radio range, zero gives every entry the maximum lifetime
+   * \param maxLifetime lifetime of an entry without advertised hold time whose neighbour is not predicted to leave range
+   */
+  void SetLifetimeModel (double range, Time maxLifetime)
+  {
+    m_range = range;
+    m_entryLifeTime = maxLifetime;
+  }
+
+  /**
+   * \brief Sets how long a neighbour residual-energy reading may be reused
+   * \param interval maximum age of a cached reading, zero reads on every use
+   */
+  void SetEnergyRefreshInterval (Time interval)
+  {
+    m_energyRefreshInterval = interval;
+  }
+
+  /**
+   * \brief Sets the residual-energy change of a neighbour that moves the epoch
+   * \param drift fraction of the energy read at the last epoch change, zero never moves it
+   */
+  void SetEnergyDrift (double drift)
+  {
+    m_energyDrift = drift;
+  }
+
   void PrintNeighbors (std::ostream &os);
 
-  //Planarizes Graph by RNG
+  /**
+   * \brief Planarizes Graph by RNG
+   *
+   * The graph is planarized in its projection on the horizontal plane, the
+   * plane BestAngle walks faces in, so altitude changes alone do not affect
+   * it. The result is cached: while the projection of nodePos does not change,
+   * neighbour inserts, removals and moves only update the pairs they take
+   * part in. A new nodePos rebuilds it.
+   */
   void PlanarizeNeighbors(Vector nodePos);
 
+  /**
+   * \brief Table epoch, incremented by every neighbour insert, removal or position change
+   *
+   * Only the positions of hellos count: dead-reckoned positions and those
+   * piggybacked on data do not change it. A residual-energy reading that
+   * drifted past the SetEnergyDrift fraction does.
+   */
+  uint32_t GetEpoch () const
+  {
+    return m_epoch;
+  }
+
+  /**
+   * \brief Purges expired entries and, with an energy drift set, re-reads stale residual energies
+   * \return the epoch afterwards
+   */
+  uint32_t Refresh ();
+
   /**
    * \brief Gets next hop according to SPIDER protocol
    * \param position the position of the destination node
@@ -116,13 +272,36 @@ public:
    */
   Ipv4Address BestNeighbor (Vector position, Vector nodePos, double lamda);
 
+  /**
+   * \brief Gets the best next hops according to SPIDER protocol, for multipath forwarding
+   *
+   * Keeps, best first, up to k candidates whose objective is within slack of
+   * the lowest one. The weight of a candidate is 1 minus that difference,
+   * the objective spanning at most 1. lamda = 1 scores progress alone, as
+   * GreedyNeighbor.
+   * \param position the position of the destination node
+   * \param nodePos the position of the node that has the packet
+   * \param hops cleared, then set to the candidates
+   */
+  void BestNeighbors (Vector position, Vector nodePos, double lamda, uint32_t k, double slack,
+                      std::vector<WeightedNeighbor> &hops);
+
+  /**
+   * \brief Gets next hop according to greedy forwarding (closest to the destination)
+   * \param position the position of the destination node
+   * \param nodePos the position of the node that has the packet
+   * \return Ipv4Address of the next hop, Ipv4Address::GetZero () if no nighbour was found in greedy mode
+   */
+  Ipv4Address GreedyNeighbor (Vector position, Vector nodePos);
+
   /**
    * \brief Gets next hop according to Electrostatics based Greedy Forwarding
    * \param position the position of the destination node
    * \param nodePos the position of the node that has the packet
+   * \param obstacles the obstacles repelling the packet
    * \return Ipv4Address of the next hop, Ipv4Address::GetZero () if no nighbour was found in Repulsion mode
    */
-  Ipv4Address ElectrostaticBestNeighbor (Vector position, Vector nodePos, double locationX, double locationY, double radius, double lamda);
+  Ipv4Address ElectrostaticBestNeighbor (Vector position, Vector nodePos, ObstacleSet &obstacles, double lamda);
 
   bool IsInSearch (Ipv4Address id);
 
@@ -135,6 +314,13 @@ public:
 
   /**
    * \brief Gets next hop according to SPIDER recovery-mode protocol (right hand rule)
+   *
+   * Projection-based face routing: angles are taken on the horizontal
+   * projection of the planarized neighbourhood. Neighbours whose projection
+   * coincides with nodePos (straight above or below) have no angle and are
+   * skipped; if previousHop projects onto nodePos the walk starts from the +x
+   * direction. At a dead end, with no other planar neighbour, the packet goes
+   * back to the neighbour along the reference edge.
    * \param previousHop the position of the node that sent the packet to this node
    * \param nodePos the position of the destination node
    * \return Ipv4Address of the next hop, Ipv4Address::GetZero () if no nighbour was found in greedy mode
@@ -146,16 +332,118 @@ public:
 
 
 private:
+  /// Returns the slot of id in the table, -1 if id is not a neighbour
+  int32_t FindSlot (Ipv4Address id) const;
+  /// Returns the index bucket that holds id, -1 if id is not indexed
+  int32_t FindBucket (Ipv4Address id) const;
+  /// Home bucket of id in the address index
+  uint32_t HomeBucket (Ipv4Address id) const;
+  /// Appends a slot for id to the table and indexes it
+  uint32_t InsertSlot (Ipv4Address id);
+  /// Removes a slot by moving the last slot into its place
+  void EraseSlot (uint32_t slot);
+  /// Removes id from the address index (backward-shift deletion)
+  void IndexErase (Ipv4Address id);
+  /// Rebuilds the address index with the given number of buckets (a power of two)
+  void IndexRehash (uint32_t buckets);
+  /// True if neighbour w lies in the RNG lune of the edge to neighbour v, in the horizontal projection
+  bool InLune (uint32_t v, uint32_t w) const;
+  /// Adds the lune tests between slot and every other neighbour to the planarization
+  void PlanarAttach (uint32_t slot);
+  /// Removes the lune tests between slot and every other neighbour from the planarization
+  void PlanarDetach (uint32_t slot);
+  /// Returns the remaining energy of the neighbour stored in slot, refreshing the cached reading once it is stale
+  double GetNeighborEnergy (uint32_t slot);
+  /// Binds slot to the node that currently owns address id and resolves its energy source
+  void BindNode (uint32_t slot, Ipv4Address id);
+  /// AddEntry without the epoch update, returns true if the entry is new or moved
+  bool StoreEntry (Ipv4Address id, Vector position, Vector velocity, Vector myPos, Vector myVelocity, Time holdTime, uint32_t iface);
+  /// MAC address of id in the ARP caches, the all-zero address if not resolved
+  Mac48Address LookupMacAddress (Ipv4Address id);
+  /// Looks up the MAC address of slot in the ARP caches and indexes it, returns false if not resolved yet
+  bool ResolveMacAddress (uint32_t slot);
+  /// Refreshes the stale energy readings of all neighbours, see GetNeighborEnergy
+  void RefreshEnergy ();
+  /// Moves the neighbours to their positions at Simulator::Now () (dead reckoning)
+  void Extrapolate ();
+  /// Seconds until a neighbour at relative position rel moving at relative velocity relVel leaves m_range, infinity if never
+  double SecondsInRange (Vector rel, Vector relVel) const;
+  /**
+   * \brief Picks the candidate with the lowest lambda-weighted objective
+   *
+   * Expects m_candMetric to hold the routing metric (distance or potential)
+   * of every slot as written by a range pass of spider-kernels.h; candidates
+   * are the slots whose metric is below bound. Both terms are min/max
+   * normalized over the candidates. Ties are broken towards the lowest address.
+   */
+  Ipv4Address SelectCandidate (double lamda, double bound, const spider::ScoreRanges &ranges);
+  /// As SelectCandidate, the best k candidates within slack of the lowest objective
+  void SelectCandidates (double lamda, double bound, const spider::ScoreRanges &ranges,
+                         uint32_t k, double slack, std::vector<WeightedNeighbor> &hops);
+
   Time m_entryLifeTime;
-  std::map<Ipv4Address, std::pair<Vector, Time> > m_table;
-  std::map<Ipv4Address, std::pair<Vector, Time> > m_nextNodes;
-  std::set<Ipv4Address> m_planarized_neighbors; //keeps set of prohibited neighbors IP addresses due graph planarization
+  double m_range;
+  Time m_energyRefreshInterval;
+  // Min-heap of (expiry time, address), one record per position update.
+  // Records made stale by a later update or a deletion are skipped when popped.
+  typedef std::pair<Time, Ipv4Address> ExpiryRecord;
+  typedef std::priority_queue<ExpiryRecord, std::vector<ExpiryRecord>, std::greater<ExpiryRecord> > ExpiryQueue;
+  ExpiryQueue m_expiry;
+  // Neighbour table as parallel arrays, one slot per neighbour, so that the
+  // scoring passes walk contiguous memory. Slot order is not meaningful.
+  std::vector<Ipv4Address> m_addr;
+  std::vector<double> m_x;
+  std::vector<double> m_y;
+  std::vector<double> m_z;
+  // Reported position (at m_update) and velocity, m_x, m_y and m_z hold the
+  // extrapolation to m_extrapolated
+  std::vector<double> m_baseX;
+  std::vector<double> m_baseY;
+  std::vector<double> m_baseZ;
+  std::vector<double> m_vx;
+  std::vector<double> m_vy;
+  std::vector<double> m_vz;
+  std::vector<Time> m_update;
+  std::vector<Time> m_expire;          ///< when the entry expires unless refreshed
+  std::vector<Time> m_hold;            ///< lifetime granted by the last hello
+  std::vector<uint32_t> m_iface;       ///< interface the neighbour was last heard on
+  std::vector<Mac48Address> m_mac;     ///< MAC address from the ARP caches, all-zero until resolved
+  Time m_extrapolated;
+  std::vector<double> m_energy;
+  std::vector<Time> m_energyTime;      ///< when m_energy was read, zero if never
+  std::vector<double> m_energyRef;     ///< m_energy at the last epoch change it caused
+  double m_energyDrift;
+  std::vector<Ptr<Node> > m_node;      ///< node owning the neighbour address
+  std::vector<Ptr<BasicEnergySource> > m_source;   ///< energy source of m_node, resolved when the binding changes
+  // Open addressing (linear probing) index from address to slot, -1 marks a free bucket
+  std::vector<int32_t> m_index;
+  // Scratch buffer reused by the scoring passes, one entry per slot
+  std::vector<double> m_candMetric;
+  // Scratch list of the obstacle charges acting on the neighbourhood
+  ChargeList m_charges;
+  // Planarization: a neighbour is prohibited while m_witnesses (the number of
+  // neighbours in the lune of its edge) is non zero. Valid for m_planarOrigin
+  // only and kept current by incremental updates while m_planarValid.
+  std::vector<uint32_t> m_witnesses;
+  Vector m_planarOrigin;
+  bool m_planarValid;
+  uint32_t m_epoch;
+  // Neighbours the MAC failed to reach, ignored by AddEntry until the time mapped
+  std::map<Ipv4Address, Time> m_blacklist;
+  Time m_blacklistTimeout;
+  // ARP caches of the interfaces, to map MAC addresses to neighbours
+  std::vector<Ptr<ArpCache> > m_arp;
+  // MAC address to neighbour, kept for blacklisted neighbours so that TX
+  // reports are resolved without an ARP lookup per neighbour
+  std::map<Mac48Address, Ipv4Address> m_macIndex;
+  // Link failure callback
+  Callback<void, Ipv4Address> m_handleLinkFailure;
+  // Neighbour update callback
+  Callback<void, Ipv4Address> m_handleNeighborUpdate;
   // TX error callback
   Callback<void, WifiMacHeader const &> m_txErrorCallback;
   // Process layer 2 TX error notification
   void ProcessTxError (WifiMacHeader const&);
-  std::map<Ipv4Address, int> m_ip;
-  NodeContainer node;
 };
 
 }   // spider
@@ -26,6 +26,12 @@
 #define SPIDER_RQUEUE_H
 
 #include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <queue>
+#include <functional>
+#include <stdint.h>
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/simulator.h"
 
@@ -122,13 +128,20 @@ private:
  * \brief SPIDER route request queue
  *
  * Since SPIDER is an on demand routing we queue requests while looking for route.
+ *
+ * The entries of each destination form a FIFO linked through a pool of
+ * nodes, a set of (packet UID, destination) pairs detects duplicates and a
+ * heap orders the entries by expiry time, so no operation scans the queue.
+ * Entries that expire or are dropped as the most aged are only unlinked
+ * when they reach the head of their FIFO.
  */
 class RequestQueue
 {
 public:
   /// Default c-tor
   RequestQueue (uint32_t maxLen, Time routeToQueueTimeout)
-    : m_maxLen (maxLen),
+    : m_size (0),
+      m_maxLen (maxLen),
       m_queueTimeout (routeToQueueTimeout)
   {
   }
@@ -142,6 +155,8 @@ public:
   bool Find (Ipv4Address dst);
   /// Number of entries
   uint32_t GetSize ();
+  /// Appends the destinations that have packets in the queue to dsts
+  void GetDestinations (std::vector<Ipv4Address> & dsts);
   ///\name Fields
   //\{
   uint32_t GetMaxQueueLen () const
@@ -163,21 +178,180 @@ public:
   //\}
 
 private:
-  std::vector<QueueEntry> m_queue;
+  /// Pool node holding one entry, linked to the next entry of the same destination
+  struct Node
+  {
+    QueueEntry entry;
+    Ipv4Address dst;
+    uint64_t uid;
+    uint32_t next;
+    uint32_t generation;                 ///< incremented each time the node is freed
+    bool live;                           ///< false once expired or dropped
+  };
+  /// Entries of one destination, oldest first
+  struct Fifo
+  {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t size;                       ///< live entries
+  };
+  typedef std::map<Ipv4Address, Fifo> FifoMap;
+  // Min-heap of (expiry time, (node, generation)). Records of nodes dequeued
+  // or dropped in the meantime are skipped when popped.
+  typedef std::pair<Time, std::pair<uint32_t, uint32_t> > ExpiryRecord;
+  typedef std::priority_queue<ExpiryRecord, std::vector<ExpiryRecord>, std::greater<ExpiryRecord> > ExpiryQueue;
+  static const uint32_t NO_NODE = 0xffffffff;
+
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_freeNodes;
+  FifoMap m_fifos;
+  std::set<std::pair<uint64_t, Ipv4Address> > m_uids;
+  ExpiryQueue m_expiry;
+  /// Number of live entries
+  uint32_t m_size;
   /// Remove all expired entries
   void Purge ();
+  /// Pops the expiry record of the oldest live entry, false if the queue is empty
+  bool PopOldest (uint32_t & node);
+  /// Marks a node dead, the FIFO of its destination unlinks it later
+  QueueEntry Kill (uint32_t node);
+  /// Returns a node to the pool
+  void FreeNode (uint32_t node);
+  /// Frees the nodes left in a FIFO without live entries and erases it
+  void EraseFifo (FifoMap::iterator fifo);
   /// Notify that packet is dropped from queue by timeout
   void Drop (QueueEntry en, std::string reason);
   /// The maximum number of packets that we allow a routing protocol to buffer.
   uint32_t m_maxLen;
   /// The maximum period of time that a routing protocol is allowed to buffer a packet for, seconds.
   Time m_queueTimeout;
-  static bool IsEqual (QueueEntry en, const Ipv4Address dst)
+};
+
+/**
+ * \ingroup spider
+ * \brief Copies of the packets handed to the MAC, per next hop
+ *
+ * Kept until the MAC reports that the frame carrying the packet went
+ * through, so that the packets of a next hop the MAC fails to reach can be
+ * forwarded again. Copies are matched to MAC reports by packet uid, which
+ * the frame keeps.
+ */
+class SalvageQueue
+{
+public:
+  /// Default c-tor
+  SalvageQueue (uint32_t maxLen, Time timeout)
+    : m_maxLen (maxLen),
+      m_queueTimeout (timeout)
+  {
+  }
+  /// Keeps a copy of a packet handed to the MAC for nextHop, forgetting the oldest one beyond the maximum length
+  void Enqueue (Ipv4Address nextHop, QueueEntry & entry);
+  /// Returns true if a copy of the packet uid is kept, and the next hop it was handed to
+  bool Find (uint64_t uid, Ipv4Address & nextHop) const;
+  /// Forgets the copy of the packet uid, the MAC delivered it
+  void Acknowledge (uint64_t uid);
+  /// Moves the copies kept for nextHop, oldest first, to entries
+  void DequeueAll (Ipv4Address nextHop, std::vector<QueueEntry> & entries);
+  /// Returns true if no copy is kept
+  bool IsEmpty () const
+  {
+    return m_queues.empty ();
+  }
+  /// Forgets all the copies
+  void Clear ()
+  {
+    m_queues.clear ();
+    m_uids.clear ();
+  }
+  ///\name Fields
+  //\{
+  uint32_t GetMaxQueueLen () const
+  {
+    return m_maxLen;
+  }
+  void SetMaxQueueLen (uint32_t len)
+  {
+    m_maxLen = len;
+  }
+  Time GetQueueTimeout () const
+  {
+    return m_queueTimeout;
+  }
+  void SetQueueTimeout (Time t)
   {
-    return (en.GetIpv4Header ().GetDestination () == dst);
+    m_queueTimeout = t;
   }
+  //\}
+
+private:
+  typedef std::map<Ipv4Address, std::deque<QueueEntry> > NextHopQueues;
+  NextHopQueues m_queues;
+  /// The next hop each copy is kept for, by packet uid
+  std::map<uint64_t, Ipv4Address> m_uids;
+  /// Forgets the copies older than m_queueTimeout, the MAC has delivered or dropped them by then
+  void Purge (std::deque<QueueEntry> & queue);
+  /// Forgets the oldest copy of queue
+  void PopFront (std::deque<QueueEntry> & queue);
+  /// The maximum number of copies kept per next hop
+  uint32_t m_maxLen;
+  /// How long a copy is kept
+  Time m_queueTimeout;
 };
 
+/**
+ * \ingroup spider
+ * \brief Packets held for a next hop, to leave in one aggregate frame
+ *
+ * The packets of a batch keep the order they were forwarded in. A batch
+ * counts the bytes its frame would carry after the shared DataHeader: a
+ * SubframeHeader, the IPv4 header and the packet, for every packet.
+ */
+class AggregationQueue
+{
+public:
+  /// Bytes entry takes in an aggregate frame
+  static uint32_t GetSubframeSize (QueueEntry const & entry);
+  /**
+   * \brief Packs entries into the subframes of an aggregate frame, see SubframeHeader
+   *
+   * The sender is stripped from the DataHeader of every packet, the frame
+   * carries it once in the DataHeader its sender adds in front.
+   */
+  static Ptr<Packet> Pack (std::vector<QueueEntry> const & entries);
+  /**
+   * \brief Splits the subframes of an aggregate frame, after its DataHeader, into entries
+   * \return false if a subframe is truncated or too short for its IPv4 header, entries then hold the packets before it
+   */
+  static bool Unpack (Ptr<const Packet> subframes, std::vector<QueueEntry> & entries);
+  /// Returns true if a batch is held for nextHop
+  bool HasBatch (Ipv4Address nextHop) const
+  {
+    return m_batches.find (nextHop) != m_batches.end ();
+  }
+  /// Bytes of the batch of nextHop, 0 without one
+  uint32_t GetBytes (Ipv4Address nextHop) const;
+  /// Appends entry to the batch of nextHop, started with route and flushed by event if there is none
+  void Enqueue (Ipv4Address nextHop, QueueEntry const & entry, Ptr<Ipv4Route> route, EventId event);
+  /**
+   * \brief Moves the batch of nextHop, oldest first, to entries and cancels its flush event
+   * \return the route of the batch, 0 without one
+   */
+  Ptr<Ipv4Route> Dequeue (Ipv4Address nextHop, std::vector<QueueEntry> & entries);
+  /// Forgets all the batches
+  void Clear ();
+
+private:
+  struct Batch
+  {
+    std::vector<QueueEntry> entries;
+    uint32_t bytes;
+    Ptr<Ipv4Route> route;       ///< route of the first packet
+    EventId flush;
+  };
+  typedef std::map<Ipv4Address, Batch> Batches;
+  Batches m_batches;
+};
 
 }
 }
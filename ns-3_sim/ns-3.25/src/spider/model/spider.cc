@@ -32,17 +32,20 @@
 #include "spider.h"
 #include "ns3/log.h"
 #include "ns3/boolean.h"
+#include "ns3/string.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/inet-socket-address.h"
 #include "ns3/trace-source-accessor.h"
 #include "ns3/udp-socket-factory.h"
 #include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
 #include "ns3/adhoc-wifi-mac.h"
 #include "ns3/energy-module.h"
 #include "ns3/object-vector.h"
 #include "ns3/object-ptr-container.h"
 #include "ns3/node-container.h"
 #include "ns3/node.h"
+#include "ns3/node-directory.h"
 #include <algorithm>
 #include <limits>
 
@@ -102,10 +105,11 @@ NS_OBJECT_ENSURE_REGISTERED (RoutingProtocol);
 
 /// UDP Port for SPIDER control traffic, not defined by IANA yet
 const uint32_t RoutingProtocol::SPIDER_PORT = 666;
+const uint8_t RoutingProtocol::AGGREGATE_PROTOCOL = 253; // RFC 3692 experimentation number
 
 RoutingProtocol::RoutingProtocol() :
 		HelloInterval(Seconds(0.25)), MaxQueueLen(64), MaxQueueTime(Seconds(30)), m_queue( //1 for 5 m/s and 0.25 for 20 m/s
-				MaxQueueLen, MaxQueueTime), HelloIntervalTimer(
+				MaxQueueLen, MaxQueueTime), m_salvage(MaxQueueLen, Seconds(0.5)), HelloIntervalTimer(
 				Timer::CANCEL_ON_DESTROY), PerimeterMode(false), RepulsionMode(
 				0) {
 	m_neighbors = PositionTable();
@@ -141,7 +145,75 @@ TypeId RoutingProtocol::GetTypeId(void) {
 					MakeUintegerChecker<uint8_t>()).AddAttribute("lambda",
                                         "lambda value",DoubleValue(0),
                                         MakeDoubleAccessor(&RoutingProtocol::lambda),
-					MakeDoubleChecker<double>()).AddAttribute("locationX",
+					MakeDoubleChecker<double>()).AddAttribute("EnergyRefreshInterval",
+					"Maximum age of a cached neighbour residual-energy reading (0 reads on every use).",
+					TimeValue(Seconds(0.25)), //one reading per default HelloInterval
+					MakeTimeAccessor(&RoutingProtocol::EnergyRefreshInterval),
+					MakeTimeChecker()).AddAttribute("RadioRange",
+					"Radio range used to predict when a moving neighbour leaves range (0 keeps every entry for NeighborLifetime).",
+					DoubleValue(0),
+					MakeDoubleAccessor(&RoutingProtocol::RadioRange),
+					MakeDoubleChecker<double>(0)).AddAttribute("NeighborLifetime",
+					"Maximum time a neighbour entry is kept without a new HELLO.",
+					TimeValue(Seconds(0.6)), //2.25 for 5 m/s and 0.6 for 20 m/s without RadioRange
+					MakeTimeAccessor(&RoutingProtocol::NeighborLifetime),
+					MakeTimeChecker()).AddAttribute("AdaptiveHello",
+					"Send HELLOs only when the node drifts from its advertised track or its advertised hold time is about to lapse.",
+					BooleanValue(false),
+					MakeBooleanAccessor(&RoutingProtocol::AdaptiveHello),
+					MakeBooleanChecker()).AddAttribute("HelloDistance",
+					"Drift from the advertised (dead-reckoned) position that triggers a HELLO with AdaptiveHello.",
+					DoubleValue(5),
+					MakeDoubleAccessor(&RoutingProtocol::HelloDistance),
+					MakeDoubleChecker<double>(0)).AddAttribute("HelloKeepAlive",
+					"HELLO period of a node that has not forwarded data for this long, with AdaptiveHello.",
+					TimeValue(Seconds(2)),
+					MakeTimeAccessor(&RoutingProtocol::HelloKeepAlive),
+					MakeTimeChecker()).AddAttribute("PositionPiggyback",
+					"Carry the sender address and position in data packets so that receivers refresh its neighbour entry. Adds 16 bytes to greedy data headers and saves HELLOs only together with OverhearPositions.",
+					BooleanValue(false),
+					MakeBooleanAccessor(&RoutingProtocol::PositionPiggyback),
+					MakeBooleanChecker()).AddAttribute("OverhearPositions",
+					"Refresh neighbour entries from overheard data frames (promiscuous mode) and skip HELLOs while data advertises the position.",
+					BooleanValue(false),
+					MakeBooleanAccessor(&RoutingProtocol::OverhearPositions),
+					MakeBooleanChecker()).AddAttribute("BlacklistTimeout",
+					"How long a neighbour the MAC failed to reach is kept out of the neighbour table (0 only evicts it).",
+					TimeValue(Seconds(1)),
+					MakeTimeAccessor(&RoutingProtocol::BlacklistTimeout),
+					MakeTimeChecker()).AddAttribute("SalvageTimeout",
+					"How long a copy of a packet handed to the MAC is kept to forward it again if its next hop fails (0 disables salvaging).",
+					TimeValue(Seconds(0.5)), //the WifiMacQueue default MaxDelay
+					MakeTimeAccessor(&RoutingProtocol::SalvageTimeout),
+					MakeTimeChecker()).AddAttribute("AggregationDelay",
+					"How long a forwarded packet is held for others to the same next hop to share its frame (0 disables aggregation).",
+					TimeValue(Seconds(0)),
+					MakeTimeAccessor(&RoutingProtocol::AggregationDelay),
+					MakeTimeChecker()).AddAttribute("AggregationSize",
+					"Bytes of packets, with their IPv4 headers, an aggregate frame carries at most; larger packets are not held.",
+					UintegerValue(1024),
+					MakeUintegerAccessor(&RoutingProtocol::AggregationSize),
+					MakeUintegerChecker<uint32_t>()).AddAttribute("NextHopCacheCell",
+					"Side of the cells a cached next hop stays valid in while the neighbour table is unchanged (0 disables the cache).",
+					DoubleValue(5),
+					MakeDoubleAccessor(&RoutingProtocol::NextHopCacheCell),
+					MakeDoubleChecker<double>(0)).AddAttribute("EnergyDrift",
+					"Relative change of a neighbour residual energy that invalidates the cached next hops.",
+					DoubleValue(0.05),
+					MakeDoubleAccessor(&RoutingProtocol::EnergyDrift),
+					MakeDoubleChecker<double>(0)).AddAttribute("MultipathK",
+					"Next hops the packets of a flow are spread over, in weighted round-robin (1 forwards each flow on the best one only).",
+					UintegerValue(1),
+					MakeUintegerAccessor(&RoutingProtocol::MultipathK),
+					MakeUintegerChecker<uint32_t>(1)).AddAttribute("MultipathSlack",
+					"Largest gap of the objective of a spread next hop to the best one, which bounds how much longer its path may be (objectives span 0 to 1).",
+					DoubleValue(0.1),
+					MakeDoubleAccessor(&RoutingProtocol::MultipathSlack),
+					MakeDoubleChecker<double>(0, 1)).AddAttribute("MaxFaceChanges",
+					"Faces a packet may change in recovery-mode before it is dropped as undeliverable.",
+					UintegerValue(16),
+					MakeUintegerAccessor(&RoutingProtocol::MaxFaceChanges),
+					MakeUintegerChecker<uint8_t>()).AddAttribute("locationX",
                                         "location obstacle on X axis",DoubleValue(0),
                                         MakeDoubleAccessor(&RoutingProtocol::locationX),
 					MakeDoubleChecker<double>()).AddAttribute("locationY",
@@ -150,7 +222,15 @@ TypeId RoutingProtocol::GetTypeId(void) {
 					MakeDoubleChecker<double>()).AddAttribute("object_radius",
                                         "radius of obstacle in scenario",DoubleValue(0),
                                         MakeDoubleAccessor(&RoutingProtocol::object_radius),
-					MakeDoubleChecker<double>());
+					MakeDoubleChecker<double>()).AddAttribute("ObstacleFile",
+					"File of obstacles for RepulsionMode (see spider::ObstacleSet); replaces the locationX, locationY, object_radius hole.",
+					StringValue(""),
+					MakeStringAccessor(&RoutingProtocol::ObstacleFile),
+					MakeStringChecker()).AddAttribute("ObstacleInfluence",
+					"Distance beyond its radius up to which an obstacle repels packets (0 for no limit).",
+					DoubleValue(0),
+					MakeDoubleAccessor(&RoutingProtocol::ObstacleInfluence),
+					MakeDoubleChecker<double>(0));
 	/*.AddAttribute("RepulsionMode",
 	 "Indicates wheteher EGF avoidance is used or not",
 	 UintegerValue(1),
@@ -163,6 +243,7 @@ RoutingProtocol::~RoutingProtocol() {
 }
 
 void RoutingProtocol::DoDispose() {
+	m_aggregate.Clear();
 	m_ipv4 = 0;
 	Ipv4RoutingProtocol::DoDispose();
 }
@@ -172,6 +253,8 @@ Ptr<LocationService> RoutingProtocol::GetLS() {
 }
 void RoutingProtocol::SetLS(Ptr<LocationService> locationService) {
 	m_locationService = locationService;
+	m_locationService->SetSearchDoneCallback(
+			MakeCallback(&RoutingProtocol::ReleaseQueue, this));
 }
 
 bool RoutingProtocol::RouteInput(Ptr<const Packet> p, const Ipv4Header &header,
@@ -202,25 +285,38 @@ bool RoutingProtocol::RouteInput(Ptr<const Packet> p, const Ipv4Header &header,
 		return true;
 	}
 
+	LearnSender(p, iif);
+
+	if (header.GetProtocol() == AGGREGATE_PROTOCOL) {
+		if (!m_ipv4->IsDestinationAddress(dst, iif)) {
+			NS_LOG_DEBUG("Aggregate frame " << p->GetUid() << " for " << dst << ". Ignored");
+			return false;
+		}
+		std::vector<QueueEntry> packets;
+		Disaggregate(p, packets);
+		for (std::vector<QueueEntry>::iterator i = packets.begin();
+				i != packets.end(); ++i) {
+			// the hop the frame made counts for each of its packets
+			Ipv4Header innerHeader = i->GetIpv4Header();
+			innerHeader.SetTtl(innerHeader.GetTtl() - 1);
+			RouteInput(i->GetPacket(), innerHeader, idev, ucb, mcb, lcb, ecb);
+		}
+		return true;
+	}
+
 	if (m_ipv4->IsDestinationAddress(dst, iif)) {
 
 		Ptr<Packet> packet = p->Copy();
-		TypeHeader tHeader(SPIDERTYPE_POS);
-		packet->RemoveHeader(tHeader);
-		if (!tHeader.IsValid()) {
+		DataHeader data;
+		packet->RemoveHeader(data);
+		if (!data.IsValid()) {
 			NS_LOG_DEBUG(
 					"SPIDER message " << packet->GetUid()
-							<< " with unknown type received: " << tHeader.Get()
-							<< ". Ignored");
+							<< " with unknown type received. Ignored");
 			return false;
 		}
 
-		if (tHeader.Get() == SPIDERTYPE_POS) {
-			PositionHeader phdr;
-			packet->RemoveHeader(phdr);
-		}
-
-		if (dst != m_ipv4->GetAddress(1, 0).GetBroadcast()) {
+		if (!IsBroadcast(dst)) {
 			NS_LOG_LOGIC("Unicast local delivery to " << dst);
 		} else {
 			NS_LOG_LOGIC("Broadcast local delivery to " << dst);
@@ -241,16 +337,12 @@ void RoutingProtocol::DeferredRouteOutput(Ptr<const Packet> p,
 
 	if (m_queue.GetSize() == 0) {
 		CheckQueueTimer.Cancel();
-		CheckQueueTimer.Schedule(Time("500ms"));
+		CheckQueueTimer.Schedule(m_queue.GetQueueTimeout());
 	}
 
 	QueueEntry newEntry(p, header, ucb, ecb);
 	bool result = m_queue.Enqueue(newEntry);
 
-	m_queuedAddresses.insert(m_queuedAddresses.begin(),
-			header.GetDestination());
-	m_queuedAddresses.unique();
-
 	if (result) {
 		NS_LOG_LOGIC(
 				"Add packet " << p->GetUid() << " to queue. Protocol "
@@ -258,31 +350,40 @@ void RoutingProtocol::DeferredRouteOutput(Ptr<const Packet> p,
 
 	}
 
+	// nothing to wait for if the location service is not searching
+	if (!m_locationService->IsInSearch(header.GetDestination())) {
+		ReleaseQueue(header.GetDestination());
+	}
 }
 
 void RoutingProtocol::CheckQueue() {
 
 	CheckQueueTimer.Cancel();
 
-	std::list<Ipv4Address> toRemove;
-
-	for (std::list<Ipv4Address>::iterator i = m_queuedAddresses.begin();
-			i != m_queuedAddresses.end(); ++i) {
-		if (SendPacketFromQueue(*i)) {
-			//Insert in a list to remove later
-			toRemove.insert(toRemove.begin(), *i);
-		}
+	// packets are released by ReleaseQueue, only drop the expired ones
+	if (m_queue.GetSize() != 0) //Only need to schedule if the queue is not empty
+	{
+		CheckQueueTimer.Schedule(m_queue.GetQueueTimeout());
 	}
+}
 
-	//remove all that are on the list
-	for (std::list<Ipv4Address>::iterator i = toRemove.begin();
-			i != toRemove.end(); ++i) {
-		m_queuedAddresses.remove(*i);
+void RoutingProtocol::ReleaseQueue(Ipv4Address dst) {
+	NS_LOG_FUNCTION(this << dst);
+	if (m_queue.Find(dst)) {
+		SendPacketFromQueue(dst);
 	}
+}
 
-	if (!m_queuedAddresses.empty()) //Only need to schedule if the queue is not empty
-	{
-		CheckQueueTimer.Schedule(Time("500ms"));
+void RoutingProtocol::ProcessNeighborUpdate(Ipv4Address neighbor) {
+	NS_LOG_FUNCTION(this << neighbor);
+	// destinations still searched wait for the location service instead
+	std::vector<Ipv4Address> queued;
+	m_queue.GetDestinations(queued);
+	for (std::vector<Ipv4Address>::const_iterator i = queued.begin();
+			i != queued.end(); ++i) {
+		if (!m_locationService->IsInSearch(*i)) {
+			ReleaseQueue(*i);
+		}
 	}
 }
 
@@ -303,71 +404,58 @@ bool RoutingProtocol::SendPacketFromQueue(Ipv4Address dst) {
 		return true;
 	}
 
+	if (m_neighbors.IsEmpty()) // kept until a neighbour shows up, see ProcessNeighborUpdate
+			{
+		return false;
+	}
+
 	Vector myPos;
 
 	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
-	myPos.x = MM->GetPosition().x;
-	myPos.y = MM->GetPosition().y;
+	myPos = MM->GetPosition();
 	Ipv4Address nextHop;
 
-	if (m_neighbors.isNeighbour(dst)) {
-		nextHop = dst;
-	} else {
-		//std::cout << "We start at Greedy Forwarding on Queue!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "]"<< std::endl;
-		Vector dstPos = m_locationService->GetPosition(dst);
-		nextHop = m_neighbors.BestNeighbor(dstPos, myPos, lambda);
-		if (nextHop == Ipv4Address::GetZero()) {
-			NS_LOG_LOGIC("Fallback to recovery-mode. Packets to " << dst);
-			recovery = true;
-		}
-		if (recovery) {
-
-			Vector Position;
-			Vector previousHop;
-			uint32_t updated;
-
-			while (m_queue.Dequeue(dst, queueEntry)) {
-				Ptr<Packet> p = ConstCast<Packet>(queueEntry.GetPacket());
-				UnicastForwardCallback ucb =
-						queueEntry.GetUnicastForwardCallback();
-				Ipv4Header header = queueEntry.GetIpv4Header();
-
-				TypeHeader tHeader(SPIDERTYPE_POS);
-				p->RemoveHeader(tHeader);
-				if (!tHeader.IsValid()) {
-					NS_LOG_DEBUG(
-							"SPIDER message " << p->GetUid()
-									<< " with unknown type received: "
-									<< tHeader.Get() << ". Drop");
-					return false;     // drop
-				}
-				if (tHeader.Get() == SPIDERTYPE_POS) {
-					PositionHeader hdr;
-					p->RemoveHeader(hdr);
-					Position.x = hdr.GetDstPosx();
-					Position.y = hdr.GetDstPosy();
-					updated = hdr.GetUpdated();
-				} else {
-					updated = 0;
-				}
-
-				PositionHeader posHeader(Position.x, Position.y, updated,
-						myPos.x, myPos.y, (uint8_t) 1, Position.x, Position.y);
-				p->AddHeader(posHeader); //enters in recovery with last edge from Dst
-				p->AddHeader(tHeader);
-
-				RecoveryMode(dst, p, ucb, header);
+	nextHop = SelectNextHop(NextHopCache::GREEDY_NEXT_HOP, dst,
+			m_locationService->GetPosition(dst), myPos);
+	if (nextHop == Ipv4Address::GetZero()) {
+		NS_LOG_LOGIC("Fallback to recovery-mode. Packets to " << dst);
+		recovery = true;
+	}
+	if (recovery) {
+
+		Vector Position;
+		Vector previousHop;
+		uint32_t updated;
+
+		while (m_queue.Dequeue(dst, queueEntry)) {
+			Ptr<Packet> p = ConstCast<Packet>(queueEntry.GetPacket());
+			UnicastForwardCallback ucb =
+					queueEntry.GetUnicastForwardCallback();
+			Ipv4Header header = queueEntry.GetIpv4Header();
+
+			DataHeader data;
+			p->PeekHeader(data);
+			if (!data.IsValid()) {
+				NS_LOG_DEBUG(
+						"SPIDER message " << p->GetUid()
+								<< " with unknown type received. Drop");
+				return false;     // drop
 			}
-			return true;
+			Position = data.GetPosition().GetDstPos();
+			updated = data.GetPosition().GetUpdated();
+
+			//enters in recovery with last edge from Dst
+			PositionHeader hdr(Position, updated, myPos, (uint8_t) 1, Position);
+			m_recoveryStats.entered++;
+			RecoveryMode(dst, p, data, hdr, ucb, header);
 		}
+		return true;
 	}
 	Ptr<Ipv4Route> route = Create<Ipv4Route>();
 	route->SetDestination(dst);
 	route->SetGateway(nextHop);
-
-	// FIXME: Does not work for multiple interfaces
-	route->SetOutputDevice(m_ipv4->GetNetDevice(1));
+	uint32_t oif = GetOutputInterface(nextHop);
+	route->SetOutputDevice(m_ipv4->GetNetDevice(oif));
 
 	while (m_queue.Dequeue(dst, queueEntry)) {
 		DeferredRouteOutputTag tag;
@@ -377,12 +465,13 @@ bool RoutingProtocol::SendPacketFromQueue(Ipv4Address dst) {
 		Ipv4Header header = queueEntry.GetIpv4Header();
 
 		if (header.GetSource() == Ipv4Address("102.102.102.102")) {
-			route->SetSource(m_ipv4->GetAddress(1, 0).GetLocal());
-			header.SetSource(m_ipv4->GetAddress(1, 0).GetLocal());
+			route->SetSource(m_ipv4->GetAddress(oif, 0).GetLocal());
+			header.SetSource(m_ipv4->GetAddress(oif, 0).GetLocal());
 		} else {
 			route->SetSource(header.GetSource());
 		}
-		ucb(route, p, header);
+		ForwardToNextHop(route, p, header, ucb,
+				queueEntry.GetErrorCallback());
 	}
 	return true;
 }
@@ -394,6 +483,7 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 	NS_LOG_FUNCTION(this);
 	Ipv4Address dst = header.GetDestination();
 	Ipv4Address origin = header.GetSource();
+	m_lastActive = Simulator::Now();
 
 	/*
 	if (m_neighbors.isNeighbour(dst)) {
@@ -408,35 +498,26 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 	Vector RecPosition;
 	uint8_t inRec = 0;
 
-	TypeHeader tHeader(SPIDERTYPE_POS);
-	PositionHeader hdr;
-	p->RemoveHeader(tHeader);
-	if (!tHeader.IsValid()) {
+	// the headers stay in the packet, rewritten only if the next hop needs other values
+	DataHeader data;
+	p->PeekHeader(data);
+	if (!data.IsValid()) {
 		NS_LOG_DEBUG(
 				"SPIDER message " << p->GetUid()
-						<< " with unknown type received: " << tHeader.Get()
-						<< ". Drop");
+						<< " with unknown type received. Drop");
 		return false;     // drop
 	}
-	if (tHeader.Get() == SPIDERTYPE_POS) {
-
-		p->RemoveHeader(hdr);
-		Position.x = hdr.GetDstPosx();
-		Position.y = hdr.GetDstPosy();
-		updated = hdr.GetUpdated();
-		RecPosition.x = hdr.GetRecPosx();
-		RecPosition.y = hdr.GetRecPosy();
-		inRec = hdr.GetInRec();
-	}
+	PositionHeader hdr = data.GetPosition();
+	Position = hdr.GetDstPos();
+	updated = hdr.GetUpdated();
+	RecPosition = hdr.GetRecPos();
+	inRec = hdr.GetInRec();
 
 	Vector myPos;
 	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
-	myPos.x = MM->GetPosition().x;
-	myPos.y = MM->GetPosition().y;
+	myPos = MM->GetPosition();
 
-	if (inRec == 1
-			&& CalculateDistance(myPos, Position)
-					< CalculateDistance(RecPosition, Position)) {
+	if (inRec == 1 && m_engine->LeaveRecovery(myPos, RecPosition, Position)) {
 		inRec = 0;
 		hdr.SetInRec(0);
 		NS_LOG_LOGIC("No longer in Recovery to " << dst << " in " << myPos);
@@ -444,9 +525,7 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 	}
 
 	if (inRec) {
-		p->AddHeader(hdr);
-		p->AddHeader(tHeader); //put headers back so that the RecoveryMode is compatible with Forwarding and SendFromQueue
-		RecoveryMode(dst, p, ucb, header);
+		RecoveryMode(dst, p, data, hdr, ucb, header);
 		return true;
 	}
 
@@ -454,47 +533,21 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 			(uint32_t) m_locationService->GetEntryUpdateTime(dst).GetSeconds();
 	if (myUpdated > updated) //check if node has an update to the position of destination
 			{
-		Position.x = m_locationService->GetPosition(dst).x;
-		Position.y = m_locationService->GetPosition(dst).y;
+		Position = m_locationService->GetPosition(dst);
 		updated = myUpdated;
 	}
 
-	Ipv4Address nextHop;
-
-	if (m_neighbors.isNeighbour(dst)) {
-		nextHop = dst;
-	} else if (RepulsionMode) {
-		//std::cout << "We start at Repulsion Mode!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-		//		<< (uint32_t) header.GetTtl() << " dstPos=" << Position << std::endl;
-		nextHop = m_neighbors.ElectrostaticBestNeighbor(Position, myPos, locationX, locationY, object_radius, lambda);
-                if (nextHop == Ipv4Address::GetZero()) {
-                //std::cout << "We switch to Greedy Forwarding!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-		//		<< (uint32_t) header.GetTtl() << std::endl;
-                    nextHop = m_neighbors.BestNeighbor(Position, myPos, lambda);                
-                }
-	} else {
-		//std::cout << "We start at Greedy Forwarding!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-	        //			<< (uint32_t) header.GetTtl() << std::endl;
-		nextHop = m_neighbors.BestNeighbor(Position, myPos, lambda);
-	}
+	Ipv4Address nextHop = SelectFlowNextHop(NextHopCache::NEXT_HOP, origin, dst,
+			Position, myPos);
 	if (nextHop != Ipv4Address::GetZero()) {
-		PositionHeader posHeader(Position.x, Position.y, updated, (uint64_t) 0,
-				(uint64_t) 0, (uint8_t) 0, myPos.x, myPos.y);
-		p->AddHeader(posHeader);
-		p->AddHeader(tHeader);
-
-		Ptr<NetDevice> oif = m_ipv4->GetObject<NetDevice>();
-		Ptr<Ipv4Route> route = Create<Ipv4Route>();
-		route->SetDestination(dst);
-		route->SetSource(header.GetSource());
-		route->SetGateway(nextHop);
-
-		// FIXME: Does not work for multiple interfaces
-		route->SetOutputDevice(m_ipv4->GetNetDevice(1));
-		route->SetDestination(header.GetDestination());
+		uint32_t oif = GetOutputInterface(nextHop);
+		PositionHeader posHeader(Position, updated, Vector(), (uint8_t) 0,
+				myPos);
+		StampSender(posHeader, oif);
+		data.Rewrite(p, posHeader);
+
+		Ptr<Ipv4Route> route = GetRoute(NextHopCache::NEXT_HOP, dst,
+				header.GetSource(), nextHop, m_ipv4->GetNetDevice(oif));
 		NS_ASSERT(route != 0);
 		NS_LOG_DEBUG(
 				"Exist route to " << route->GetDestination()
@@ -505,21 +558,20 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 						<< origin << " through " << route->GetGateway()
 						<< " packet " << p->GetUid());
 
-		ucb(route, p, header);
+		ForwardToNextHop(route, p, header, ucb, ecb);
 		return true;
 	} else {
                 //std::cout << "Entering recovery-mode to " << dst << " in "
 		//	<< m_ipv4->GetAddress(1, 0).GetLocal() << " dstPos=" << Position 
                 //      << "if dst is neighbor? - " << m_neighbors.isNeighbour(dst)<< std::endl;
 		hdr.SetInRec(1);
-		hdr.SetRecPosx(myPos.x);
-		hdr.SetRecPosy(myPos.y);
-		hdr.SetLastPosx(Position.x); //when entering Recovery, the first edge is the Dst
-		hdr.SetLastPosy(Position.y);
+		hdr.SetRecPos(myPos);
+		hdr.SetLastPos(Position); //when entering Recovery, the first edge is the Dst
+		hdr.SetFaceEntry(myPos);
+		hdr.SetFaceChanges(0);
+		m_recoveryStats.entered++;
 
-		p->AddHeader(hdr);
-		p->AddHeader(tHeader);
-		RecoveryMode(dst, p, ucb, header);
+		RecoveryMode(dst, p, data, hdr, ucb, header);
 
 		NS_LOG_LOGIC(
 				"Entering recovery-mode to " << dst << " in "
@@ -529,7 +581,8 @@ bool RoutingProtocol::Forwarding(Ptr<const Packet> packet,
 }
 
 void RoutingProtocol::RecoveryMode(Ipv4Address dst, Ptr<Packet> p,
-		UnicastForwardCallback ucb, Ipv4Header header) {
+		DataHeader data, PositionHeader hdr, UnicastForwardCallback ucb,
+		Ipv4Header header) {
 //	std::cout << "We start at Recovery Mode!" << "[node "
 //			<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
 //			<< (uint32_t) header.GetTtl() << std::endl;
@@ -537,67 +590,75 @@ void RoutingProtocol::RecoveryMode(Ipv4Address dst, Ptr<Packet> p,
 	Vector Position;
 	Vector previousHop;
 	uint32_t updated;
-	uint64_t positionX;
-	uint64_t positionY;
 	Vector myPos;
 	Vector recPos;
 
 	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
-	positionX = MM->GetPosition().x;
-	positionY = MM->GetPosition().y;
-	myPos.x = positionX;
-	myPos.y = positionY;
+	myPos = MM->GetPosition();
 
-	TypeHeader tHeader(SPIDERTYPE_POS);
-	p->RemoveHeader(tHeader);
-	if (!tHeader.IsValid()) {
-		NS_LOG_DEBUG(
-				"SPIDER message " << p->GetUid()
-						<< " with unknown type received: " << tHeader.Get()
-						<< ". Drop");
-		return;     // drop
-	}
-	if (tHeader.Get() == SPIDERTYPE_POS) {
-		PositionHeader hdr;
-		p->RemoveHeader(hdr);
-		Position.x = hdr.GetDstPosx();
-		Position.y = hdr.GetDstPosy();
-		updated = hdr.GetUpdated();
-		recPos.x = hdr.GetRecPosx();
-		recPos.y = hdr.GetRecPosy();
-		previousHop.x = hdr.GetLastPosx();
-		previousHop.y = hdr.GetLastPosy();
-	} else {
-		updated = 0;
-	}
-
-	PositionHeader posHeader(Position.x, Position.y, updated, recPos.x,
-			recPos.y, (uint8_t) 1, myPos.x, myPos.y);
-	p->AddHeader(posHeader);
-	p->AddHeader(tHeader);
+	Position = hdr.GetDstPos();
+	updated = hdr.GetUpdated();
+	recPos = hdr.GetRecPos();
+	previousHop = hdr.GetLastPos();
 
-	Ipv4Address nextHop = m_neighbors.BestAngle(previousHop, myPos);
+	Ipv4Address nextHop = m_engine->RecoveryNextHop(m_neighbors, previousHop, myPos);
 	//m_neighbors.PrintNeighbors(std::cout);
 	//std::cout << std::endl;
 	if (nextHop == Ipv4Address::GetZero()) {
+		m_recoveryStats.deadEnds++;
+		NS_LOG_LOGIC("No neighbour to recover through. Drop packet " << p->GetUid()
+				<< " to " << dst);
 		return;
 	}
-	/* FIXME add correct termination of the Recvery Mode
-	 Vector nextPos = m_neighbors.GetPosition(nextHop);
-	 if(previousHop.x == r)
-	 {
-	 return; //drop packet as it went through
-	 }*/
+
+	// change face on an edge crossing the line to the destination, the first
+	// edge of the new face is the next one counterclockwise
+	Vector faceEntry = hdr.GetFaceEntry();
+	uint8_t faceChanges = hdr.GetFaceChanges();
+	bool newFace = false;
+	while (m_engine->ChangeFace(myPos, m_neighbors.GetNeighborPosition(nextHop),
+			recPos, Position, faceEntry)) {
+		if (faceChanges >= MaxFaceChanges) {
+			m_recoveryStats.faceLimits++;
+			NS_LOG_LOGIC("Face change limit reached. Drop packet " << p->GetUid()
+					<< " to " << dst);
+			return;
+		}
+		faceChanges++;
+		m_recoveryStats.faceChanges++;
+		newFace = true;
+		nextHop = m_engine->RecoveryNextHop(m_neighbors,
+				m_neighbors.GetNeighborPosition(nextHop), myPos);
+	}
+
+	uint32_t oif = GetOutputInterface(nextHop);
+	Ipv4Address me = m_ipv4->GetAddress(oif, 0).GetLocal();
+	PositionHeader posHeader(Position, updated, recPos, (uint8_t) 1, myPos);
+	posHeader.SetFaceEntry(faceEntry);
+	posHeader.SetFaceChanges(faceChanges);
+	if (!newFace && hdr.HasFirstEdge()) {
+		if (hdr.IsFirstEdge(me, nextHop)) {
+			// the face was walked around without getting closer: no way to dst
+			m_recoveryStats.loops++;
+			NS_LOG_LOGIC("Recovery loop detected. Drop packet " << p->GetUid()
+					<< " to " << dst);
+			return;
+		}
+		posHeader.SetFirstEdge(hdr.GetFirstEdgeFrom(), hdr.GetFirstEdgeTo());
+	} else {
+		posHeader.SetFirstEdge(me, nextHop);
+	}
 
 	Ptr<Ipv4Route> route = Create<Ipv4Route>();
 	route->SetDestination(dst);
 	route->SetGateway(nextHop);
-
-	// FIXME: Does not work for multiple interfaces
-	route->SetOutputDevice(m_ipv4->GetNetDevice(1));
+	route->SetOutputDevice(m_ipv4->GetNetDevice(oif));
 	route->SetSource(header.GetSource());
 
-	ucb(route, p, header);
+	StampSender(posHeader, oif);
+	data.Rewrite(p, posHeader);
+
+	ForwardToNextHop(route, p, header, ucb, ErrorCallback());
 	return;
 }
 
@@ -612,6 +673,7 @@ void RoutingProtocol::NotifyInterfaceUp(uint32_t interface) {
 	if (iface.GetLocal() == Ipv4Address("127.0.0.1")) {
 		return;
 	}
+	NodeDirectory::Add(iface.GetLocal(), GetObject<Node>());
 
 	// Create a socket to listen only on this interface
 	Ptr < Socket > socket = Socket::CreateSocket(GetObject<Node>(),
@@ -627,6 +689,11 @@ void RoutingProtocol::NotifyInterfaceUp(uint32_t interface) {
 	// Allow neighbor manager use this interface for layer 2 feedback if possible
 	Ptr<NetDevice> dev = m_ipv4->GetNetDevice(
 			m_ipv4->GetInterfaceForAddress(iface.GetLocal()));
+	if (OverhearPositions) {
+		m_ipv4->GetObject<Node>()->RegisterProtocolHandler(
+				MakeCallback(&RoutingProtocol::Overhear, this),
+				Ipv4L3Protocol::PROT_NUMBER, dev, true);
+	}
 	Ptr<WifiNetDevice> wifi = dev->GetObject<WifiNetDevice>();
 	if (wifi == 0) {
 		return;
@@ -638,6 +705,13 @@ void RoutingProtocol::NotifyInterfaceUp(uint32_t interface) {
 
 	mac->TraceConnectWithoutContext("TxErrHeader",
 			m_neighbors.GetTxErrorCallback());
+	mac->TraceConnectWithoutContext("TxErrHeader",
+			MakeCallback(&RoutingProtocol::ProcessTxError, this));
+	mac->TraceConnectWithoutContext("TxOkHeader",
+			MakeCallback(&RoutingProtocol::ProcessTxOk, this));
+	wifi->GetPhy()->TraceConnectWithoutContext("PhyTxBegin",
+			MakeCallback(&RoutingProtocol::ProcessPhyTxBegin, this));
+	m_neighbors.AddArpCache(l3->GetInterface(interface)->GetArpCache());
 
 }
 
@@ -659,20 +733,24 @@ void RoutingProtocol::RecvSPIDER(Ptr<Socket> socket) {
 	HelloHeader hdr;
 	packet->RemoveHeader(hdr);
 	Vector Position;
-	Position.x = hdr.GetOriginPosx();
-	Position.y = hdr.GetOriginPosy();
+	Position = hdr.GetOriginPos();
 	InetSocketAddress inetSourceAddr = InetSocketAddress::ConvertFrom(
 			sourceAddress);
 	Ipv4Address sender = inetSourceAddr.GetIpv4();
 	Ipv4Address receiver = m_socketAddresses[socket].GetLocal();
 
-	UpdateRouteToNeighbor(sender, receiver, Position);
+	m_beaconStats.received++;
+	UpdateRouteToNeighbor(sender, receiver, Position, hdr.GetVelocity(),
+			hdr.GetHoldTime());
 
 }
 
 void RoutingProtocol::UpdateRouteToNeighbor(Ipv4Address sender,
-		Ipv4Address receiver, Vector Pos) {
-	m_neighbors.AddEntry(sender, Pos);
+		Ipv4Address receiver, Vector Pos, Vector velocity, Time holdTime) {
+	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
+	m_neighbors.AddEntry(sender, Pos, velocity, MM->GetPosition(),
+			MM->GetVelocity(), holdTime,
+			m_ipv4->GetInterfaceForAddress(receiver));
 
 }
 
@@ -688,7 +766,14 @@ void RoutingProtocol::NotifyInterfaceDown(uint32_t interface) {
 		if (mac != 0) {
 			mac->TraceDisconnectWithoutContext("TxErrHeader",
 					m_neighbors.GetTxErrorCallback());
+			mac->TraceDisconnectWithoutContext("TxErrHeader",
+					MakeCallback(&RoutingProtocol::ProcessTxError, this));
+			mac->TraceDisconnectWithoutContext("TxOkHeader",
+					MakeCallback(&RoutingProtocol::ProcessTxOk, this));
+			wifi->GetPhy()->TraceDisconnectWithoutContext("PhyTxBegin",
+					MakeCallback(&RoutingProtocol::ProcessPhyTxBegin, this));
 		}
+		m_neighbors.DelArpCache(l3->GetInterface(interface)->GetArpCache());
 	}
 
 	// Close socket
@@ -698,11 +783,25 @@ void RoutingProtocol::NotifyInterfaceDown(uint32_t interface) {
 	socket->Close();
 	m_socketAddresses.erase(socket);
 	if (m_socketAddresses.empty()) {
-		NS_LOG_LOGIC("No spider interfaces");
-		m_neighbors.Clear();
-		m_locationService->Clear();
+		StopRouting();
 		return;
 	}
+	m_neighbors.DeleteInterface(interface);
+}
+
+void RoutingProtocol::StopRouting() {
+	NS_LOG_LOGIC("No spider interfaces");
+	if (OverhearPositions) {
+		m_ipv4->GetObject<Node>()->UnregisterProtocolHandler(
+				MakeCallback(&RoutingProtocol::Overhear, this));
+	}
+	m_neighbors.Clear();
+	m_nextHops.Clear();
+	m_flows.Clear();
+	m_salvage.Clear();
+	m_txFrames.clear();
+	m_aggregate.Clear();
+	m_locationService->Clear();
 }
 
 Ptr<Socket> RoutingProtocol::FindSocketWithInterfaceAddress(
@@ -724,6 +823,9 @@ void RoutingProtocol::NotifyAddAddress(uint32_t interface,
 		Ipv4InterfaceAddress address) {
 	NS_LOG_FUNCTION(
 			this << " interface " << interface << " address " << address);
+	if (address.GetLocal() != Ipv4Address("127.0.0.1")) {
+		NodeDirectory::Add(address.GetLocal(), GetObject<Node>());
+	}
 	Ptr<Ipv4L3Protocol> l3 = m_ipv4->GetObject<Ipv4L3Protocol>();
 	if (!l3->IsUp(interface)) {
 		return;
@@ -759,9 +861,10 @@ void RoutingProtocol::NotifyAddAddress(uint32_t interface,
 void RoutingProtocol::NotifyRemoveAddress(uint32_t i,
 		Ipv4InterfaceAddress address) {
 	NS_LOG_FUNCTION(this);
+	NodeDirectory::Remove(address.GetLocal());
 	Ptr < Socket > socket = FindSocketWithInterfaceAddress(address);
 	if (socket) {
-
+		socket->Close();
 		m_socketAddresses.erase(socket);
 		Ptr<Ipv4L3Protocol> l3 = m_ipv4->GetObject<Ipv4L3Protocol>();
 		if (l3->GetNAddresses(i)) {
@@ -783,11 +886,13 @@ void RoutingProtocol::NotifyRemoveAddress(uint32_t i,
 
 		}
 		if (m_socketAddresses.empty()) {
-			NS_LOG_LOGIC("No spider interfaces");
-			m_neighbors.Clear();
-			m_locationService->Clear();
+			StopRouting();
 			return;
 		}
+		if (l3->GetNAddresses(i) == 0) {
+			// the neighbours heard on it could not be reached without a source address
+			m_neighbors.DeleteInterface(i);
+		}
 	} else {
 		NS_LOG_LOGIC("Remove address not participating in SPIDER operation");
 	}
@@ -809,26 +914,56 @@ void RoutingProtocol::SetIpv4(Ptr<Ipv4> ipv4) {
 }
 
 void RoutingProtocol::HelloTimerExpire() {
-	SendHello();
+	if (!AdaptiveHello) {
+		// data frames overheard by the whole neighbourhood stand in for the HELLO
+		if (OverhearPositions && PositionPiggyback
+				&& Simulator::Now() - m_lastAdvertised < HelloInterval / 2) {
+			m_beaconStats.suppressed++;
+		} else {
+			SendHello();
+		}
+	} else {
+		Time now = Simulator::Now();
+		Time elapsed = now - m_lastAdvertised;
+		Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
+		Vector predicted = m_lastAdvertisedPos;
+		predicted.x += m_lastHelloVelocity.x * elapsed.GetSeconds();
+		predicted.y += m_lastHelloVelocity.y * elapsed.GetSeconds();
+		predicted.z += m_lastHelloVelocity.z * elapsed.GetSeconds();
+
+		// refresh one jittered tick ahead of the deadline neighbours were given
+		Time period = std::min(GetHelloPeriod(), m_lastHelloPeriod);
+		if (elapsed + HelloInterval / 2 >= period) {
+			m_beaconStats.refreshed++;
+			SendHello();
+		} else if (CalculateDistance(MM->GetPosition(), predicted) > HelloDistance) {
+			m_beaconStats.moved++;
+			SendHello();
+		} else {
+			m_beaconStats.suppressed++;
+		}
+	}
 	HelloIntervalTimer.Cancel();
 	HelloIntervalTimer.Schedule(HelloInterval + JITTER);
 }
 
 void RoutingProtocol::SendHello() {
 	NS_LOG_FUNCTION(this);
-	double positionX;
-	double positionY;
-
 	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
-
-	positionX = MM->GetPosition().x;
-	positionY = MM->GetPosition().y;
+	Vector position = MM->GetPosition();
+	Vector velocity = MM->GetVelocity();
+	Time period = GetHelloPeriod();
+	// neighbours keep us for the same number of periods NeighborLifetime covers at HelloInterval
+	Time hold = Seconds(NeighborLifetime.GetSeconds() * period.GetSeconds()
+			/ HelloInterval.GetSeconds());
 
 	for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
 			m_socketAddresses.begin(); j != m_socketAddresses.end(); ++j) {
 		Ptr < Socket > socket = j->first;
 		Ipv4InterfaceAddress iface = j->second;
-		HelloHeader helloHeader(((uint64_t) positionX), ((uint64_t) positionY));
+		HelloHeader helloHeader(position.x, position.y, position.z);
+		helloHeader.SetVelocity(velocity);
+		helloHeader.SetHoldTime(hold);
 
 		Ptr<Packet> packet = Create<Packet>();
 		packet->AddHeader(helloHeader);
@@ -844,6 +979,355 @@ void RoutingProtocol::SendHello() {
 		socket->SendTo(packet, 0, InetSocketAddress(destination, SPIDER_PORT));
 
 	}
+	m_lastAdvertised = Simulator::Now();
+	m_lastHelloPeriod = period;
+	m_lastAdvertisedPos = position;
+	m_lastHelloVelocity = velocity;
+	m_beaconStats.sent++;
+}
+
+void RoutingProtocol::StampSender(PositionHeader &hdr, uint32_t oif) {
+	if (!PositionPiggyback) {
+		return;
+	}
+	hdr.SetSender(m_ipv4->GetAddress(oif, 0).GetLocal());
+	if (OverhearPositions && m_socketAddresses.size() == 1) {
+		// every neighbour hears the position, as with a HELLO
+		m_lastAdvertised = Simulator::Now();
+		m_lastAdvertisedPos = hdr.GetLastPos();
+	}
+}
+
+void RoutingProtocol::LearnSender(Ptr<const Packet> p, uint32_t iif) {
+	DataHeader data;
+	p->PeekHeader(data);
+	if (!data.IsValid()) {
+		return;
+	}
+	PositionHeader const &hdr = data.GetPosition();
+	if (!hdr.HasSender() || IsMyOwnAddress(hdr.GetSender())) {
+		return;
+	}
+	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
+	m_neighbors.RefreshEntry(hdr.GetSender(), hdr.GetLastPos(),
+			MM->GetPosition(), MM->GetVelocity(), iif);
+}
+
+void RoutingProtocol::Overhear(Ptr<NetDevice> device, Ptr<const Packet> packet,
+		uint16_t protocol, const Address &from, const Address &to,
+		NetDevice::PacketType packetType) {
+	if (packetType != NetDevice::PACKET_OTHERHOST) {
+		return; // frames for this node reach RouteInput
+	}
+	Ptr<Packet> p = packet->Copy();
+	Ipv4Header ipHeader;
+	p->RemoveHeader(ipHeader);
+	// only UDP and TCP packets go through AddHeaders and carry SPIDER headers, aggregate frames share one
+	if (ipHeader.GetProtocol() != 17 && ipHeader.GetProtocol() != 6
+			&& ipHeader.GetProtocol() != AGGREGATE_PROTOCOL) {
+		return;
+	}
+	LearnSender(p, m_ipv4->GetInterfaceForDevice(device));
+}
+
+void RoutingProtocol::ForwardToNextHop(Ptr<Ipv4Route> route, Ptr<Packet> p,
+		const Ipv4Header &header, UnicastForwardCallback ucb,
+		ErrorCallback ecb) {
+	if (AggregationDelay > Seconds(0) && Aggregate(route, p, header, ucb, ecb)) {
+		return;
+	}
+	if (SalvageTimeout > Seconds(0)) {
+		QueueEntry entry(p->Copy(), header, ucb, ecb);
+		m_salvage.Enqueue(route->GetGateway(), entry);
+	}
+	ucb(route, p, header);
+}
+
+bool RoutingProtocol::Aggregate(Ptr<Ipv4Route> route, Ptr<Packet> p,
+		const Ipv4Header &header, UnicastForwardCallback ucb,
+		ErrorCallback ecb) {
+	Ipv4Address nextHop = route->GetGateway();
+	QueueEntry entry(p, header, ucb, ecb);
+	uint32_t size = AggregationQueue::GetSubframeSize(entry);
+	if (size > AggregationSize || header.GetTtl() < 2) {
+		// sent alone, IpForward drops it if it expires here; the packets held go first
+		FlushAggregate(nextHop);
+		return false;
+	}
+	if (m_aggregate.GetBytes(nextHop) + size > AggregationSize) {
+		FlushAggregate(nextHop);
+	}
+	EventId flush;
+	if (!m_aggregate.HasBatch(nextHop)) {
+		flush = Simulator::Schedule(AggregationDelay,
+				&RoutingProtocol::FlushAggregate, this, nextHop);
+	}
+	m_aggregate.Enqueue(nextHop, entry, route, flush);
+	NS_LOG_LOGIC(
+			"Hold packet " << p->GetUid() << " for " << nextHop << ", "
+					<< m_aggregate.GetBytes(nextHop) << " bytes held");
+	if (m_aggregate.GetBytes(nextHop) == AggregationSize) {
+		FlushAggregate(nextHop);
+	}
+	return true;
+}
+
+void RoutingProtocol::FlushAggregate(Ipv4Address nextHop) {
+	std::vector<QueueEntry> entries;
+	Ptr<Ipv4Route> route = m_aggregate.Dequeue(nextHop, entries);
+	if (entries.empty()) {
+		return;
+	}
+	UnicastForwardCallback ucb = entries.front().GetUnicastForwardCallback();
+	ErrorCallback ecb = entries.front().GetErrorCallback();
+	Ptr<Packet> frame;
+	Ipv4Header header;
+	if (entries.size() == 1) {
+		frame = ConstCast<Packet>(entries.front().GetPacket());
+		header = entries.front().GetIpv4Header();
+	} else {
+		frame = AggregationQueue::Pack(entries);
+		uint32_t oif = m_ipv4->GetInterfaceForDevice(route->GetOutputDevice());
+		Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
+		PositionHeader posHeader(Vector(), 0, Vector(), (uint8_t) 0,
+				MM->GetPosition());
+		StampSender(posHeader, oif);
+		frame->AddHeader(DataHeader(posHeader));
+
+		Ipv4Address source = m_ipv4->GetAddress(oif, 0).GetLocal();
+		header.SetSource(source);
+		header.SetDestination(nextHop);
+		header.SetProtocol(AGGREGATE_PROTOCOL);
+		header.SetTtl(2); // IpForward takes one off, the next hop delivers it locally
+		header.SetPayloadSize(frame->GetSize());
+
+		Ptr<Ipv4Route> frameRoute = Create<Ipv4Route>();
+		frameRoute->SetDestination(nextHop);
+		frameRoute->SetSource(source);
+		frameRoute->SetGateway(nextHop);
+		frameRoute->SetOutputDevice(route->GetOutputDevice());
+		route = frameRoute;
+		NS_LOG_LOGIC(
+				"Aggregate " << entries.size() << " packets to " << nextHop
+						<< " in frame " << frame->GetUid());
+	}
+	if (SalvageTimeout > Seconds(0)) {
+		QueueEntry entry(frame->Copy(), header, ucb, ecb);
+		m_salvage.Enqueue(nextHop, entry);
+	}
+	ucb(route, frame, header);
+}
+
+void RoutingProtocol::Disaggregate(Ptr<const Packet> frame,
+		std::vector<QueueEntry> &entries) const {
+	Ptr<Packet> p = frame->Copy();
+	DataHeader data;
+	p->RemoveHeader(data);
+	if (!AggregationQueue::Unpack(p, entries)) {
+		NS_LOG_DEBUG("Malformed aggregate frame " << frame->GetUid() << ". Drop the rest");
+	}
+}
+
+void RoutingProtocol::ProcessPhyTxBegin(Ptr<const Packet> packet) {
+	if (m_salvage.IsEmpty()) {
+		return;
+	}
+	WifiMacHeader hdr;
+	packet->PeekHeader(hdr);
+	Ipv4Address nextHop;
+	// only SPIDER data frames, those with a copy, get a report; ARP and other traffic is ignored
+	if (!hdr.IsData() || hdr.GetAddr1().IsGroup()
+			|| !m_salvage.Find(packet->GetUid(), nextHop)) {
+		return;
+	}
+	// a retry keeps the sequence number, and the record
+	m_txFrames[TxFrame(std::make_pair(hdr.GetAddr2(), hdr.GetAddr1()),
+			hdr.GetSequenceNumber())] = packet->GetUid();
+}
+
+bool RoutingProtocol::TakeTxFrame(WifiMacHeader const &hdr, uint64_t &uid) {
+	if (m_txFrames.empty()) {
+		return false;
+	}
+	std::map<TxFrame, uint64_t>::iterator i = m_txFrames.find(
+			TxFrame(std::make_pair(hdr.GetAddr2(), hdr.GetAddr1()),
+					hdr.GetSequenceNumber()));
+	if (i == m_txFrames.end()) {
+		return false;
+	}
+	uid = i->second;
+	m_txFrames.erase(i);
+	return true;
+}
+
+void RoutingProtocol::ProcessTxOk(WifiMacHeader const &hdr) {
+	uint64_t uid;
+	if (TakeTxFrame(hdr, uid)) {
+		m_salvage.Acknowledge(uid);
+	}
+}
+
+void RoutingProtocol::ProcessTxError(WifiMacHeader const &hdr) {
+	uint64_t uid;
+	Ipv4Address nextHop;
+	if (!TakeTxFrame(hdr, uid) || !m_salvage.Find(uid, nextHop)) {
+		return;
+	}
+	// a neighbour is blacklisted and salvaged by m_neighbors, see
+	// PositionTable::ProcessTxError; one that expired meanwhile is not
+	if (!m_neighbors.isNeighbour(nextHop)) {
+		Salvage(nextHop);
+	}
+}
+
+void RoutingProtocol::Salvage(Ipv4Address nextHop) {
+	// the frames queued behind the failed one are taken too: they wait for
+	// the same next hop and would spend a retry budget each
+	std::vector<QueueEntry> entries;
+	m_salvage.DequeueAll(nextHop, entries);
+	m_aggregate.Dequeue(nextHop, entries);
+	for (std::vector<QueueEntry>::iterator i = entries.begin();
+			i != entries.end(); ++i) {
+		Ptr<Packet> p = ConstCast<Packet>(i->GetPacket());
+		Ipv4Header header = i->GetIpv4Header();
+		if (header.GetProtocol() == AGGREGATE_PROTOCOL) {
+			// its packets are forwarded again one by one
+			std::vector<QueueEntry> packets;
+			Disaggregate(p, packets);
+			for (std::vector<QueueEntry>::iterator j = packets.begin();
+					j != packets.end(); ++j) {
+				Forwarding(j->GetPacket(), j->GetIpv4Header(),
+						i->GetUnicastForwardCallback(), i->GetErrorCallback());
+			}
+			continue;
+		}
+		NS_LOG_LOGIC(
+				"Salvage packet " << p->GetUid() << " to "
+						<< header.GetDestination() << " from failed next hop "
+						<< nextHop);
+		if (i->GetUnicastForwardCallback().IsNull()) {
+			AddHeaders(p, header.GetSource(), header.GetDestination(),
+					header.GetProtocol(), Ptr<Ipv4Route>());
+		} else {
+			Forwarding(p, header, i->GetUnicastForwardCallback(),
+					i->GetErrorCallback());
+		}
+	}
+}
+
+Ipv4Address RoutingProtocol::SelectNextHop(NextHopCache::Mode mode,
+		Ipv4Address dst, Vector dstPos, Vector myPos) {
+	Ipv4Address nextHop;
+	if (m_nextHops.IsEnabled()
+			&& m_nextHops.Lookup(dst, mode, dstPos, myPos, m_neighbors.Refresh(),
+					nextHop)) {
+		return nextHop;
+	}
+	if (mode == NextHopCache::NEXT_HOP) {
+		nextHop = m_engine->NextHop(m_neighbors, dst, dstPos, myPos);
+	} else {
+		nextHop = m_engine->GreedyNextHop(m_neighbors, dst, dstPos, myPos);
+	}
+	if (m_nextHops.IsEnabled()) {
+		// energy readings taken while scoring may have moved the epoch
+		m_nextHops.Insert(dst, mode, dstPos, myPos, m_neighbors.GetEpoch(),
+				nextHop);
+	}
+	return nextHop;
+}
+
+Ipv4Address RoutingProtocol::SelectFlowNextHop(NextHopCache::Mode mode,
+		Ipv4Address source, Ipv4Address dst, Vector dstPos, Vector myPos) {
+	if (MultipathK < 2) {
+		return SelectNextHop(mode, dst, dstPos, myPos);
+	}
+	if (!m_nextHops.IsEnabled()
+			|| !m_nextHops.LookupHops(dst, mode, dstPos, myPos,
+					m_neighbors.Refresh(), m_hops)) {
+		if (mode == NextHopCache::NEXT_HOP) {
+			m_engine->NextHops(m_neighbors, dst, dstPos, myPos, MultipathK,
+					MultipathSlack, m_hops);
+		} else {
+			m_engine->GreedyNextHops(m_neighbors, dst, dstPos, myPos,
+					MultipathK, MultipathSlack, m_hops);
+		}
+		if (m_nextHops.IsEnabled()) {
+			m_nextHops.InsertHops(dst, mode, dstPos, myPos,
+					m_neighbors.GetEpoch(), m_hops);
+		}
+	}
+	if (m_hops.empty()) {
+		return Ipv4Address::GetZero();
+	}
+	if (m_hops.size() == 1) {
+		return m_hops[0].first;
+	}
+	return m_flows.Select(source, dst, m_hops, Simulator::Now());
+}
+
+Ptr<Ipv4Route> RoutingProtocol::GetRoute(NextHopCache::Mode mode,
+		Ipv4Address dst, Ipv4Address source, Ipv4Address nextHop,
+		Ptr<NetDevice> oif) {
+	Ptr<Ipv4Route> route = m_nextHops.GetRoute(dst, mode);
+	if (route != 0 && route->GetSource() == source
+			&& route->GetGateway() == nextHop
+			&& route->GetOutputDevice() == oif) {
+		return route;
+	}
+	route = Create<Ipv4Route>();
+	route->SetDestination(dst);
+	route->SetSource(source);
+	route->SetGateway(nextHop);
+	route->SetOutputDevice(oif);
+	m_nextHops.SetRoute(dst, mode, route);
+	return route;
+}
+
+Ptr<Ipv4Route> RoutingProtocol::SetRouteContext(Ptr<Ipv4Route> route,
+		Vector dstPos, uint32_t updated, Ipv4Address nextHop) {
+	m_routeContext.route = route;
+	m_routeContext.time = Simulator::Now();
+	m_routeContext.dstPos = dstPos;
+	m_routeContext.updated = updated;
+	m_routeContext.nextHop = nextHop;
+	return route;
+}
+
+Time RoutingProtocol::GetHelloPeriod() const {
+	if (!AdaptiveHello || Simulator::Now() - m_lastActive < HelloKeepAlive) {
+		return HelloInterval;
+	}
+	return HelloKeepAlive;
+}
+
+double RoutingProtocol::GetBeaconRate() const {
+	double elapsed = (Simulator::Now() - m_startTime).GetSeconds();
+	return elapsed > 0 ? m_beaconStats.sent / elapsed : 0;
+}
+
+uint32_t RoutingProtocol::GetOutputInterface(Ipv4Address nextHop) {
+	uint32_t oif = m_neighbors.GetInterface(nextHop);
+	if (oif != 0) {
+		return oif;
+	}
+	// not heard on any interface, take the one whose subnet holds it
+	for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
+			m_socketAddresses.begin(); j != m_socketAddresses.end(); ++j) {
+		if (j->second.GetMask().IsMatch(j->second.GetLocal(), nextHop)) {
+			return m_ipv4->GetInterfaceForAddress(j->second.GetLocal());
+		}
+	}
+	return 1;
+}
+
+bool RoutingProtocol::IsBroadcast(Ipv4Address dst) {
+	for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator j =
+			m_socketAddresses.begin(); j != m_socketAddresses.end(); ++j) {
+		if (dst == j->second.GetBroadcast()) {
+			return true;
+		}
+	}
+	return false;
 }
 
 bool RoutingProtocol::IsMyOwnAddress(Ipv4Address src) {
@@ -858,10 +1342,47 @@ bool RoutingProtocol::IsMyOwnAddress(Ipv4Address src) {
 	return false;
 }
 
+Ptr<ObstacleSet> RoutingProtocol::GetObstacles() const {
+	if (!ObstacleFile.empty()) {
+		return ObstacleSet::Load(ObstacleFile, ObstacleInfluence);
+	}
+	Ptr<ObstacleSet> obstacles = Create<ObstacleSet>();
+	obstacles->SetInfluenceRadius(ObstacleInfluence);
+	obstacles->AddCircle(locationX, locationY, object_radius);
+	return obstacles;
+}
+
 void RoutingProtocol::Start() {
 	//std::cout<<"SPIDER protocol has started at node["<<m_ipv4->GetObject<Node>()->GetId()<<"]"<<std::endl;
 	NS_LOG_FUNCTION(this);
-	m_queuedAddresses.clear();
+	m_neighbors.SetEnergyRefreshInterval(EnergyRefreshInterval);
+	m_neighbors.SetLifetimeModel(RadioRange, NeighborLifetime);
+	m_neighbors.SetBlacklistTimeout(BlacklistTimeout);
+	m_neighbors.SetEnergyDrift(EnergyDrift);
+	m_nextHops.SetCellSize(NextHopCacheCell);
+	m_neighbors.SetLinkFailureCallback(
+			MakeCallback(&RoutingProtocol::Salvage, this));
+	m_neighbors.SetNeighborUpdateCallback(
+			MakeCallback(&RoutingProtocol::ProcessNeighborUpdate, this));
+	m_salvage.SetQueueTimeout(SalvageTimeout);
+
+	m_beaconStats = BeaconStats();
+	m_recoveryStats = RecoveryStats();
+	m_startTime = Simulator::Now();
+	// idle, and the first HELLO is due at once
+	m_lastActive = m_startTime - HelloKeepAlive;
+	m_lastAdvertised = m_startTime - HelloKeepAlive - HelloInterval;
+	m_lastHelloPeriod = HelloInterval;
+
+	// the forwarding configuration is fixed for the lifetime of the protocol
+	EnergyWeightedScoring scoring(lambda);
+	if (RepulsionMode) {
+		m_engine = MakeForwardingEngine(
+				ElectrostaticScoring<EnergyWeightedScoring>(scoring,
+						GetObstacles(), lambda), RightHandRecovery());
+	} else {
+		m_engine = MakeForwardingEngine(scoring, RightHandRecovery());
+	}
 
 	//FIXME ajustar timer, meter valor parametrizavel
 	Time tableTime("2s");
@@ -876,6 +1397,10 @@ void RoutingProtocol::Start() {
 	 NS_LOG_UNCOND("RLS not yet implemented");
 	 break;
 	 }
+	if (m_locationService != 0) {
+		m_locationService->SetSearchDoneCallback(
+				MakeCallback(&RoutingProtocol::ReleaseQueue, this));
+	}
 
 
 }
@@ -920,36 +1445,53 @@ void RoutingProtocol::AddHeaders(Ptr<Packet> p, Ipv4Address source,
 	NS_LOG_FUNCTION(
 			this << " source " << source << " destination " << destination);
 
+	if (!destination.IsBroadcast() && !IsBroadcast(destination)) {
+		m_lastActive = Simulator::Now(); // data, not a HELLO
+	}
+
 	Vector myPos;
 	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
-	myPos.x = MM->GetPosition().x;
-	myPos.y = MM->GetPosition().y;
+	myPos = MM->GetPosition();
 
 	Ipv4Address nextHop;
+	Vector position;
+	uint32_t hdrTime = 0;
 
-	if (m_neighbors.isNeighbour(destination)) {
-		nextHop = destination;
-	} else {
-		nextHop = m_neighbors.BestNeighbor(
-				m_locationService->GetPosition(destination), myPos, lambda);
+	if (!IsBroadcast(destination)) {
+		if (route != 0 && route == m_routeContext.route
+				&& m_routeContext.time == Simulator::Now()
+				&& route->GetDestination() == destination) {
+			// decided by the RouteOutput call this packet just went through
+			position = m_routeContext.dstPos;
+			hdrTime = m_routeContext.updated;
+			nextHop = m_routeContext.nextHop;
+			m_routeContext.route = 0;
+		} else {
+			position = m_locationService->GetPosition(destination);
+			hdrTime =
+					(uint32_t) m_locationService->GetEntryUpdateTime(destination).GetSeconds();
+			nextHop = SelectNextHop(NextHopCache::GREEDY_NEXT_HOP, destination,
+					position, myPos);
+		}
 	}
 
-	uint64_t positionX = 0;
-	uint64_t positionY = 0;
-	uint32_t hdrTime = 0;
-
-	if (destination != m_ipv4->GetAddress(1, 0).GetBroadcast()) {
-		positionX = m_locationService->GetPosition(destination).x;
-		positionY = m_locationService->GetPosition(destination).y;
-		hdrTime =
-				(uint32_t) m_locationService->GetEntryUpdateTime(destination).GetSeconds();
+	if (SalvageTimeout > Seconds(0) && route != 0
+			&& m_neighbors.isNeighbour(route->GetGateway())) {
+		// salvaged by running AddHeaders again, without the route
+		Ipv4Header header;
+		header.SetSource(source);
+		header.SetDestination(destination);
+		header.SetProtocol(protocol);
+		QueueEntry entry(p->Copy(), header);
+		m_salvage.Enqueue(route->GetGateway(), entry);
 	}
 
-	PositionHeader posHeader(positionX, positionY, hdrTime, (uint64_t) 0,
-			(uint64_t) 0, (uint8_t) 0, myPos.x, myPos.y);
-	p->AddHeader(posHeader);
-	TypeHeader tHeader(SPIDERTYPE_POS);
-	p->AddHeader(tHeader);
+	PositionHeader posHeader(position, hdrTime, Vector(), (uint8_t) 0, myPos);
+	if (nextHop != Ipv4Address::GetZero()) {
+		// deferred packets leave later, from wherever the node is then
+		StampSender(posHeader, GetOutputInterface(nextHop));
+	}
+	p->AddHeader(DataHeader(posHeader));
 
 	if(protocol == (uint8_t) 17)
 	{
@@ -992,15 +1534,17 @@ Ptr<Ipv4Route> RoutingProtocol::RouteOutput(Ptr<Packet> p,
 		return route;
 	}
 	sockerr = Socket::ERROR_NOTERROR;
-	Ptr<Ipv4Route> route = Create<Ipv4Route>();
 	Ipv4Address dst = header.GetDestination();
 
 	Vector dstPos = Vector(1, 0, 0);
+	uint32_t updated = 0;
 
-	if (!(dst == m_ipv4->GetAddress(1, 0).GetBroadcast())) {
+	if (!IsBroadcast(dst)) {
 //		std::cout << "requested dst address is " << dst << " broadcast addr="
 //				<< m_ipv4->GetAddress(1, 0).GetBroadcast() << std::endl;
 		dstPos = m_locationService->GetPosition(dst);
+		updated =
+				(uint32_t) m_locationService->GetEntryUpdateTime(dst).GetSeconds();
 	}
 
 	if (CalculateDistance(dstPos, m_locationService->GetInvalidPosition()) == 0
@@ -1009,44 +1553,28 @@ Ptr<Ipv4Route> RoutingProtocol::RouteOutput(Ptr<Packet> p,
 		if (!p->PeekPacketTag(tag)) {
 			p->AddPacketTag(tag);
 		}
-		return LoopbackRoute(header, oif);
+		return SetRouteContext(LoopbackRoute(header, oif), dstPos, updated,
+				Ipv4Address::GetZero());
 	}
 
 	Vector myPos;
 	Ptr<MobilityModel> MM = m_ipv4->GetObject<MobilityModel>();
-	myPos.x = MM->GetPosition().x;
-	myPos.y = MM->GetPosition().y;
-
-	Ipv4Address nextHop;
+	myPos = MM->GetPosition();
 
-	if (m_neighbors.isNeighbour(dst)) {
-		nextHop = dst;
-	} else if (false) {
-		std::cout << "We start at Repulsion Mode!" << "[node "
-				<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-				<< (uint32_t) header.GetTtl() << std::endl;
-		nextHop = m_neighbors.ElectrostaticBestNeighbor(dstPos, myPos,locationX,locationY,object_radius, lambda);
-	} else {
-		//std::cout << "We start at Greedy Forwarding!" << "[node "
-		//		<< m_ipv4->GetObject<Node>()->GetId() << "] ttl="
-		//		<< (uint32_t) header.GetTtl() << std::endl;
-		nextHop = m_neighbors.BestNeighbor(dstPos, myPos, lambda);
-	}
+	Ipv4Address nextHop = SelectFlowNextHop(NextHopCache::GREEDY_NEXT_HOP,
+			header.GetSource(), dst, dstPos, myPos);
 
 	if (nextHop != Ipv4Address::GetZero()) {
 		NS_LOG_DEBUG("Destination: " << dst);
 
-		route->SetDestination(dst);
-		if (header.GetSource() == Ipv4Address("102.102.102.102")) {
-			route->SetSource(m_ipv4->GetAddress(1, 0).GetLocal());
-		} else {
-			route->SetSource(header.GetSource());
+		// leave through the interface the next hop was heard on
+		uint32_t nextHopIf = GetOutputInterface(nextHop);
+		Ipv4Address source = header.GetSource();
+		if (source == Ipv4Address("102.102.102.102")) {
+			source = m_ipv4->GetAddress(nextHopIf, 0).GetLocal();
 		}
-		route->SetGateway(nextHop);
-		route->SetOutputDevice(
-				m_ipv4->GetNetDevice(
-						m_ipv4->GetInterfaceForAddress(route->GetSource())));
-		route->SetDestination(header.GetDestination());
+		Ptr<Ipv4Route> route = GetRoute(NextHopCache::GREEDY_NEXT_HOP, dst,
+				source, nextHop, m_ipv4->GetNetDevice(nextHopIf));
 		NS_ASSERT(route != 0);
 		NS_LOG_DEBUG(
 				"Exist route to " << route->GetDestination()
@@ -1056,13 +1584,15 @@ Ptr<Ipv4Route> RoutingProtocol::RouteOutput(Ptr<Packet> p,
 			sockerr = Socket::ERROR_NOROUTETOHOST;
 			return Ptr<Ipv4Route>();
 		}
-		return route;
+		return SetRouteContext(route, dstPos, updated, nextHop);
 	} else {
 		DeferredRouteOutputTag tag;
 		if (!p->PeekPacketTag(tag)) {
 			p->AddPacketTag(tag);
 		}
-		return LoopbackRoute(header, oif); //in RouteInput the recovery-mode is called
+		//in RouteInput the recovery-mode is called
+		return SetRouteContext(LoopbackRoute(header, oif), dstPos, updated,
+				Ipv4Address::GetZero());
 	}
 
 }
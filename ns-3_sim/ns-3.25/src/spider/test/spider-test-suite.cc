@@ -0,0 +1,1072 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/****************************************************************************/
+/* This file is part of SPIDER project.                                       */
+/*                                                                          */
+/* SPIDER is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by     */
+/* the Free Software Foundation, either version 3 of the License, or        */
+/* (at your option) any later version.                                      */
+/*                                                                          */
+/* SPIDER is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of           */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
+/* GNU General Public License for more details.                             */
+/*                                                                          */
+/* You should have received a copy of the GNU General Public License        */
+/* along with SPIDER.  If not, see <http://www.gnu.org/licenses/>.            */
+/*                                                                          */
+/****************************************************************************/
+
+#include "ns3/test.h"
+#include "ns3/simulator.h"
+#include "ns3/node.h"
+#include "ns3/basic-energy-source.h"
+#include "ns3/energy-source-container.h"
+#include "ns3/node-directory.h"
+#include "ns3/spider-ptable.h"
+#include "ns3/spider-kernels.h"
+#include "ns3/spider-obstacles.h"
+#include "ns3/spider-rqueue.h"
+#include "ns3/spider-packet.h"
+#include <complex>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <vector>
+
+using namespace ns3;
+using namespace ns3::spider;
+
+namespace {
+
+/// Deterministic generator (xorshift64), the tables do not depend on the run seed
+class SpiderTestRng
+{
+public:
+  SpiderTestRng (uint64_t seed)
+    : m_state (seed * 0x9E3779B97F4A7C15ULL + 1)
+  {
+  }
+
+  uint64_t Next (void)
+  {
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 7;
+    m_state ^= m_state << 17;
+    return m_state;
+  }
+
+  /// Integer in [0, n)
+  uint32_t Integer (uint32_t n)
+  {
+    return Next () % n;
+  }
+
+  /// Real in [lo, hi)
+  double Uniform (double lo, double hi)
+  {
+    return lo + (hi - lo) * ((Next () >> 11) * (1.0 / 9007199254740992.0));
+  }
+
+private:
+  uint64_t m_state;
+};
+
+/// A point of the [-50, 50] integer grid, so that collinear neighbours occur
+Vector
+GridPoint (SpiderTestRng &rng)
+{
+  return Vector (rng.Integer (101) - 50.0, rng.Integer (101) - 50.0, 0);
+}
+
+/// PositionTable::GetAngle before the pseudo-angle kernel, on the complex logarithm
+double
+LegacyAngle (Vector centrePos, Vector refPos, Vector node)
+{
+  double const PI = 4 * atan (1);
+
+  std::complex<double> A = std::complex<double> (centrePos.x, centrePos.y);
+  std::complex<double> B = std::complex<double> (node.x, node.y);
+  std::complex<double> C = std::complex<double> (refPos.x, refPos.y);
+
+  std::complex<double> AB = B - A;
+  AB = (real (AB) / norm (AB))
+    + (std::complex<double> (0.0, 1.0) * (imag (AB) / norm (AB)));
+  std::complex<double> AC = C - A;
+  AC = (real (AC) / norm (AC))
+    + (std::complex<double> (0.0, 1.0) * (imag (AC) / norm (AC)));
+
+  std::complex<double> Angle = log (AC / AB) * std::complex<double> (0.0, -1.0);
+  Angle *= (180 / PI);
+  if (real (Angle) < 0)
+    {
+      Angle = 360 + real (Angle);
+    }
+  return real (Angle);
+}
+
+/**
+ * GetAngle left the neighbours along the reference edge at 0 or, by rounding,
+ * a few 1e-15 degrees either side of it. The kernel puts them at exactly 0.
+ */
+const double ALONG_EDGE = 1e-9;
+
+bool
+LegacyAlongEdge (double angle)
+{
+  return angle < ALONG_EDGE || angle > 360 - ALONG_EDGE;
+}
+
+typedef std::map<Ipv4Address, Vector> LegacyTable;
+
+/**
+ * The recovery-mode choice of the map-ordered table before the kernels:
+ * Gabriel planarization, then the smallest counterclockwise angle from the
+ * previous hop, the lowest address on ties. The neighbours along the
+ * reference edge are the way back, taken at a dead end (see LegacyAlongEdge).
+ * GetAngle is NaN, and never picked, for a neighbour on nodePos.
+ */
+Ipv4Address
+LegacyBestAngle (const LegacyTable &table, Vector previousHop, Vector nodePos)
+{
+  Ipv4Address bestFoundID = Ipv4Address::GetZero ();
+  Ipv4Address backID = Ipv4Address::GetZero ();
+  double bestFoundAngle = 360;
+  for (LegacyTable::const_iterator i = table.begin (); i != table.end (); i++)
+    {
+      bool prohibited = false;
+      for (LegacyTable::const_iterator j = table.begin (); j != table.end (); j++)
+        {
+          if (i->first != j->first
+              && CalculateDistance (nodePos, i->second)
+              > std::max (CalculateDistance (nodePos, j->second),
+                          CalculateDistance (i->second, j->second)))
+            {
+              prohibited = true;
+              break;
+            }
+        }
+      if (prohibited)
+        {
+          continue;
+        }
+      double tmpAngle = LegacyAngle (nodePos, previousHop, i->second);
+      if (LegacyAlongEdge (tmpAngle))
+        {
+          if (backID == Ipv4Address::GetZero ())
+            {
+              backID = i->first;
+            }
+        }
+      else if (bestFoundAngle > tmpAngle)
+        {
+          bestFoundID = i->first;
+          bestFoundAngle = tmpAngle;
+        }
+    }
+  return bestFoundID == Ipv4Address::GetZero () ? backID : bestFoundID;
+}
+
+/// Routing metric and residual energy of a neighbour, by address
+typedef std::map<Ipv4Address, std::pair<double, double> > LegacyScores;
+
+/**
+ * The greedy choice of the map-ordered table before the kernels: candidates
+ * have a metric below bound, metric and energy are normalized over the
+ * candidates and the lowest objective wins, the lowest address on ties.
+ * The baseline divided by a collapsed range and lost every candidate to the
+ * NaN; such a term now contributes 0.
+ *
+ * \param gap receives the distance of the runner-up objective to the lowest
+ */
+Ipv4Address
+LegacySelect (const LegacyScores &scores, double bound, double lamda, double &gap)
+{
+  double minMetric = std::numeric_limits<double>::infinity ();
+  double maxMetric = -minMetric;
+  double minEnergy = minMetric;
+  double maxEnergy = -minMetric;
+  for (LegacyScores::const_iterator i = scores.begin (); i != scores.end (); i++)
+    {
+      if (bound > i->second.first)
+        {
+          minMetric = std::min (minMetric, i->second.first);
+          maxMetric = std::max (maxMetric, i->second.first);
+          minEnergy = std::min (minEnergy, i->second.second);
+          maxEnergy = std::max (maxEnergy, i->second.second);
+        }
+    }
+  Ipv4Address bestFoundID = Ipv4Address::GetZero ();
+  double minObj = std::numeric_limits<double>::infinity ();
+  gap = minObj;
+  for (LegacyScores::const_iterator i = scores.begin (); i != scores.end (); i++)
+    {
+      if (!(bound > i->second.first))
+        {
+          continue;
+        }
+      double metric = maxMetric > minMetric ? (i->second.first - minMetric) / (maxMetric - minMetric) : 0;
+      double energy = maxEnergy > minEnergy ? (i->second.second - minEnergy) / (maxEnergy - minEnergy) : 0;
+      double Obj = lamda * metric + (1 - lamda) * -energy;
+      if (minObj > Obj)
+        {
+          gap = minObj - Obj;
+          bestFoundID = i->first;
+          minObj = Obj;
+        }
+      else
+        {
+          gap = std::min (gap, Obj - minObj);
+        }
+    }
+  return bestFoundID;
+}
+
+/// Potential of the single-hole electrostatic objective before the obstacle sets
+double
+LegacyPotential (Vector position, Vector dst, Vector holeC, double holeR)
+{
+  double q = 1;
+  double n = 2;
+  double b = CalculateDistance (holeC, dst);
+  double ql = (q * std::pow (holeR, n + 1)) / (n * std::pow (b + holeR, 2));
+  return -q / CalculateDistance (position, dst)
+    + ql / (std::pow (CalculateDistance (position, holeC), n));
+}
+
+const KernelIsa ISAS[] = { KERNEL_ISA_SCALAR, KERNEL_ISA_SSE2, KERNEL_ISA_AVX2 };
+const char * const ISA_NAMES[] = { "scalar", "SSE2", "AVX2" };
+const uint32_t N_ISAS = 3;
+
+} // anonymous namespace
+
+/**
+ * \ingroup spider
+ * \brief Neighbours with an energy source each, for the scoring tests
+ */
+class SpiderScoringTestCase : public TestCase
+{
+public:
+  SpiderScoringTestCase (std::string name);
+
+protected:
+  /// Number of neighbours with an energy source
+  static const uint32_t POOL = 40;
+
+  /// Address of neighbour i of the pool
+  static Ipv4Address GetAddress (uint32_t i);
+
+  /// Adds neighbour i at position with the given residual energy
+  void AddNeighbor (PositionTable &table, uint32_t i, Vector position, double energy);
+
+private:
+  virtual void DoSetup (void);
+  virtual void DoTeardown (void);
+
+  std::vector<Ptr<BasicEnergySource> > m_sources;
+};
+
+SpiderScoringTestCase::SpiderScoringTestCase (std::string name)
+  : TestCase (name)
+{
+}
+
+Ipv4Address
+SpiderScoringTestCase::GetAddress (uint32_t i)
+{
+  return Ipv4Address (0x0a010001 + i);
+}
+
+void
+SpiderScoringTestCase::AddNeighbor (PositionTable &table, uint32_t i, Vector position, double energy)
+{
+  m_sources[i]->SetInitialEnergy (energy);
+  table.AddEntry (GetAddress (i), position);
+}
+
+void
+SpiderScoringTestCase::DoSetup (void)
+{
+  for (uint32_t i = 0; i < POOL; i++)
+    {
+      Ptr<Node> node = CreateObject<Node> ();
+      Ptr<BasicEnergySource> source = CreateObject<BasicEnergySource> ();
+      Ptr<EnergySourceContainer> sources = CreateObject<EnergySourceContainer> ();
+      sources->Add (source);
+      node->AggregateObject (sources);
+      NodeDirectory::Add (GetAddress (i), node);
+      m_sources.push_back (source);
+    }
+}
+
+void
+SpiderScoringTestCase::DoTeardown (void)
+{
+  m_sources.clear ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \ingroup spider
+ * \brief BestNeighbor and ElectrostaticBestNeighbor pick the neighbour of
+ * the map-ordered objective on every instruction set
+ */
+class SpiderScoringRandomTestCase : public SpiderScoringTestCase
+{
+public:
+  SpiderScoringRandomTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpiderScoringRandomTestCase::SpiderScoringRandomTestCase ()
+  : SpiderScoringTestCase ("greedy objectives against the map-ordered selection")
+{
+}
+
+void
+SpiderScoringRandomTestCase::DoRun (void)
+{
+  SpiderTestRng rng (4);
+  const double lamdas[] = { 0, 0.3, 0.5, 1 };
+  for (uint32_t trial = 0; trial < 300; trial++)
+    {
+      // integer positions and few energy levels, so that objectives tie often
+      Vector nodePos = GridPoint (rng);
+      Vector dst (rng.Integer (101) - 50.0, 200, 0);
+      Vector holeC (dst.x, rng.Integer (2) == 0 ? -100 : 100, 0);
+      double holeR = 5 + rng.Integer (20);
+      double lamda = lamdas[rng.Integer (4)];
+      uint32_t levels = 1 + rng.Integer (3);
+      Ptr<ObstacleSet> obstacles = Create<ObstacleSet> ();
+      obstacles->AddCircle (holeC.x, holeC.y, holeR);
+
+      PositionTable table;
+      LegacyScores distances;
+      LegacyScores potentials;
+      uint32_t n = 1 + rng.Integer (POOL);
+      for (uint32_t k = 0; k < n; k++)
+        {
+          uint32_t i = rng.Integer (POOL);
+          Vector position = GridPoint (rng);
+          if (rng.Integer (3) == 0)
+            {
+              // the mirror image of a position, same metric in both objectives
+              position.x = 2 * dst.x - position.x;
+            }
+          double energy = 50.0 * (1 + rng.Integer (levels));
+          AddNeighbor (table, i, position, energy);
+          distances[GetAddress (i)] = std::make_pair (CalculateDistance (position, dst), energy);
+          potentials[GetAddress (i)] = std::make_pair (LegacyPotential (position, dst, holeC, holeR), energy);
+        }
+
+      double distanceGap;
+      double potentialGap;
+      Ipv4Address greedy = LegacySelect (distances, CalculateDistance (nodePos, dst), lamda, distanceGap);
+      Ipv4Address electrostatic = LegacySelect (potentials, LegacyPotential (nodePos, dst, holeC, holeR),
+                                                lamda, potentialGap);
+      for (uint32_t k = 0; k < N_ISAS; k++)
+        {
+          if (SetKernelIsa (ISAS[k]) != ISAS[k])
+            {
+              continue;
+            }
+          // the distances are computed like the baseline did, bit for bit
+          NS_TEST_ASSERT_MSG_EQ (table.BestNeighbor (dst, nodePos, lamda), greedy,
+                                 "BestNeighbor, " << ISA_NAMES[k] << ", trial " << trial);
+          // the potentials are not, skip objectives closer than their rounding
+          if (potentialGap == 0 || potentialGap > 1e-9)
+            {
+              NS_TEST_ASSERT_MSG_EQ (table.ElectrostaticBestNeighbor (dst, nodePos, *obstacles, lamda),
+                                     electrostatic,
+                                     "ElectrostaticBestNeighbor, " << ISA_NAMES[k] << ", trial " << trial);
+            }
+        }
+      SetKernelIsa (GetSupportedKernelIsa ());
+    }
+}
+
+/**
+ * \ingroup spider
+ * \brief Ties, collapsed ranges and single candidates of the greedy objectives
+ */
+class SpiderScoringTieTestCase : public SpiderScoringTestCase
+{
+public:
+  SpiderScoringTieTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Checks both objectives on every instruction set
+  void Check (PositionTable &table, double lamda, Ipv4Address expected, std::string what);
+
+  Vector m_nodePos;
+  Vector m_dst;
+  Ptr<ObstacleSet> m_obstacles;
+};
+
+SpiderScoringTieTestCase::SpiderScoringTieTestCase ()
+  : SpiderScoringTestCase ("greedy objectives on ties and collapsed ranges"),
+    m_nodePos (0, 0, 0),
+    m_dst (100, 0, 0)
+{
+}
+
+void
+SpiderScoringTieTestCase::Check (PositionTable &table, double lamda, Ipv4Address expected, std::string what)
+{
+  for (uint32_t k = 0; k < N_ISAS; k++)
+    {
+      if (SetKernelIsa (ISAS[k]) != ISAS[k])
+        {
+          continue;
+        }
+      NS_TEST_EXPECT_MSG_EQ (table.BestNeighbor (m_dst, m_nodePos, lamda), expected,
+                             "BestNeighbor, " << what << ", lamda " << lamda << ", " << ISA_NAMES[k]);
+      NS_TEST_EXPECT_MSG_EQ (table.ElectrostaticBestNeighbor (m_dst, m_nodePos, *m_obstacles, lamda), expected,
+                             "ElectrostaticBestNeighbor, " << what << ", lamda " << lamda << ", " << ISA_NAMES[k]);
+    }
+  SetKernelIsa (GetSupportedKernelIsa ());
+}
+
+void
+SpiderScoringTieTestCase::DoRun (void)
+{
+  // a hole behind the node, on the axis through the destination
+  m_obstacles = Create<ObstacleSet> ();
+  m_obstacles->AddCircle (-50, 0, 10);
+  const double lamdas[] = { 0, 0.5, 1 };
+
+  for (uint32_t l = 0; l < 3; l++)
+    {
+      double lamda = lamdas[l];
+      {
+        // neighbours behind the node make no progress
+        PositionTable table;
+        AddNeighbor (table, 3, Vector (-10, 0, 0), 100);
+        AddNeighbor (table, 1, Vector (-20, 5, 0), 50);
+        Check (table, lamda, Ipv4Address::GetZero (), "no candidate");
+      }
+      {
+        // both ranges collapse on one candidate
+        PositionTable table;
+        AddNeighbor (table, 5, Vector (10, 0, 0), 100);
+        AddNeighbor (table, 2, Vector (-10, 0, 0), 200);
+        AddNeighbor (table, 1, Vector (-5, -5, 0), 10);
+        Check (table, lamda, GetAddress (5), "one candidate");
+      }
+      {
+        // mirror images with equal energies: both ranges collapse, the lowest address wins
+        PositionTable table;
+        AddNeighbor (table, 9, Vector (50, 30, 0), 100);
+        AddNeighbor (table, 7, Vector (50, -30, 0), 100);
+        AddNeighbor (table, 8, Vector (-10, 0, 0), 10);
+        Check (table, lamda, GetAddress (7), "collapsed ranges");
+      }
+      {
+        // many mirror images on few energy levels, inserted against address order
+        PositionTable table;
+        for (uint32_t i = 20; i-- > 10;)
+          {
+            double y = 10.0 * (1 + i % 2);
+            AddNeighbor (table, i, Vector (40, i % 4 < 2 ? y : -y, 0), i % 3 == 0 ? 100 : 60);
+          }
+        // closest are i % 2 == 0 at |y| = 10, the most energy has i % 3 == 0
+        Check (table, lamda, GetAddress (lamda == 1 ? 10 : 12), "energy ties");
+      }
+    }
+}
+
+/**
+ * \ingroup spider
+ * \brief The pseudo-angles order neighbours like the complex-log GetAngle
+ */
+class SpiderRhrAngleTestCase : public TestCase
+{
+public:
+  SpiderRhrAngleTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpiderRhrAngleTestCase::SpiderRhrAngleTestCase ()
+  : TestCase ("RHR pseudo-angles against the complex-log GetAngle")
+{
+}
+
+void
+SpiderRhrAngleTestCase::DoRun (void)
+{
+  SpiderTestRng rng (1);
+  for (uint32_t trial = 0; trial < 400; trial++)
+    {
+      // even trials on the integer grid, where edges line up exactly
+      bool grid = trial % 2 == 0;
+      uint32_t n = 1 + rng.Integer (40);
+      Vector centre = grid ? GridPoint (rng) : Vector (rng.Uniform (0, 1000), rng.Uniform (0, 1000), 0);
+      Vector ref;
+      do
+        {
+          ref = grid ? GridPoint (rng) : Vector (rng.Uniform (0, 1000), rng.Uniform (0, 1000), 0);
+        }
+      while (ref.x == centre.x && ref.y == centre.y);
+
+      std::vector<double> x (n), y (n), angle (n), legacy (n);
+      std::vector<bool> alongEdge (n);
+      for (uint32_t i = 0; i < n; i++)
+        {
+          Vector node;
+          if (grid && rng.Integer (6) == 0)
+            {
+              double k = 1 + rng.Integer (3);
+              node = Vector (centre.x + k * (ref.x - centre.x), centre.y + k * (ref.y - centre.y), 0);
+            }
+          else
+            {
+              do
+                {
+                  node = grid ? GridPoint (rng) : Vector (rng.Uniform (0, 1000), rng.Uniform (0, 1000), 0);
+                }
+              while (node.x == centre.x && node.y == centre.y);
+            }
+          x[i] = node.x;
+          y[i] = node.y;
+          legacy[i] = LegacyAngle (centre, ref, node);
+          // exact on the grid: same direction as the reference edge
+          double bx = node.x - centre.x, by = node.y - centre.y;
+          double cx = ref.x - centre.x, cy = ref.y - centre.y;
+          alongEdge[i] = grid && bx * cy - by * cx == 0 && bx * cx + by * cy > 0;
+        }
+      RhrPseudoAngles (&x[0], &y[0], n, centre.x, centre.y, ref.x, ref.y, &angle[0]);
+
+      for (uint32_t i = 0; i < n; i++)
+        {
+          if (alongEdge[i])
+            {
+              NS_TEST_ASSERT_MSG_EQ (angle[i], 0, "neighbour along the reference edge, trial " << trial);
+              NS_TEST_ASSERT_MSG_EQ (LegacyAlongEdge (legacy[i]), true,
+                                     "GetAngle far from 0 along the reference edge, trial " << trial);
+              continue;
+            }
+          NS_TEST_ASSERT_MSG_EQ (angle[i] > 0 && angle[i] < 4, true,
+                                 "pseudo-angle out of (0, 4), trial " << trial);
+          for (uint32_t j = 0; j < i; j++)
+            {
+              if (alongEdge[j])
+                {
+                  continue;
+                }
+              if (legacy[i] < legacy[j] - ALONG_EDGE)
+                {
+                  NS_TEST_ASSERT_MSG_LT (angle[i], angle[j], "order differs from GetAngle, trial " << trial);
+                }
+              else if (legacy[j] < legacy[i] - ALONG_EDGE)
+                {
+                  NS_TEST_ASSERT_MSG_LT (angle[j], angle[i], "order differs from GetAngle, trial " << trial);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * \ingroup spider
+ * \brief PositionTable::BestAngle picks the neighbour of the map-ordered table
+ */
+class SpiderBestAngleTestCase : public TestCase
+{
+public:
+  SpiderBestAngleTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpiderBestAngleTestCase::SpiderBestAngleTestCase ()
+  : TestCase ("BestAngle against the map-ordered complex-log selection")
+{
+}
+
+void
+SpiderBestAngleTestCase::DoRun (void)
+{
+  SpiderTestRng rng (2);
+  for (uint32_t trial = 0; trial < 300; trial++)
+    {
+      PositionTable table;
+      LegacyTable legacy;
+      Vector nodePos = GridPoint (rng);
+      uint32_t n = 1 + rng.Integer (30);
+      for (uint32_t i = 0; i < n; i++)
+        {
+          Ipv4Address id (0x0a000001 + rng.Integer (1000));
+          // a few on the node itself, where GetAngle has no angle either
+          Vector pos = rng.Integer (8) == 0 ? nodePos : GridPoint (rng);
+          table.AddEntry (id, pos);
+          legacy[id] = pos;
+        }
+
+      // a few lookups per table, the planarization is reused between them
+      for (uint32_t lookup = 0; lookup < 4; lookup++)
+        {
+          if (lookup == 3)
+            {
+              nodePos = GridPoint (rng);
+            }
+          Vector previousHop;
+          if (rng.Integer (2) == 0)
+            {
+              LegacyTable::const_iterator i = legacy.begin ();
+              std::advance (i, rng.Integer (legacy.size ()));
+              previousHop = i->second;
+            }
+          else
+            {
+              previousHop = GridPoint (rng);
+            }
+          if (previousHop.x == nodePos.x && previousHop.y == nodePos.y)
+            {
+              continue;
+            }
+          NS_TEST_ASSERT_MSG_EQ (table.BestAngle (previousHop, nodePos),
+                                 LegacyBestAngle (legacy, previousHop, nodePos),
+                                 "trial " << trial << " lookup " << lookup);
+        }
+    }
+}
+
+/**
+ * \ingroup spider
+ * \brief BestAngle skips the neighbours straight above or below the node
+ */
+class SpiderBestAngleStackedTestCase : public TestCase
+{
+public:
+  SpiderBestAngleStackedTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpiderBestAngleStackedTestCase::SpiderBestAngleStackedTestCase ()
+  : TestCase ("BestAngle with vertically stacked neighbours")
+{
+}
+
+void
+SpiderBestAngleStackedTestCase::DoRun (void)
+{
+  Vector nodePos (0, 0, 50);
+  Vector previousHop (-10, 0, 50);
+  Ipv4Address below (0x0a000001);
+  Ipv4Address above (0x0a000002);
+  Ipv4Address back (0x0a000003);
+  Ipv4Address ahead (0x0a000004);
+
+  PositionTable table;
+  table.AddEntry (below, Vector (0, 0, 20));
+  table.AddEntry (above, Vector (0, 0, 80));
+  NS_TEST_ASSERT_MSG_EQ (table.BestAngle (previousHop, nodePos), Ipv4Address::GetZero (),
+                         "a stacked neighbour is not a way on");
+
+  table.AddEntry (back, previousHop);
+  NS_TEST_ASSERT_MSG_EQ (table.BestAngle (previousHop, nodePos), back,
+                         "at a dead end the packet goes back, not up or down");
+
+  table.AddEntry (ahead, Vector (10, 5, 40));
+  NS_TEST_ASSERT_MSG_EQ (table.BestAngle (previousHop, nodePos), ahead,
+                         "the other neighbour is the way on");
+}
+
+/**
+ * \ingroup spider
+ * \brief BestAngle on neighbours moving between hellos
+ *
+ * The planarization of a fixed node is kept across lookups while the
+ * extrapolated neighbours move; it has to match a fresh one at every step.
+ */
+class SpiderBestAngleMobilityTestCase : public TestCase
+{
+public:
+  SpiderBestAngleMobilityTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Compares BestAngle with the selection on the positions extrapolated to now
+  void Lookup (uint32_t step);
+
+  SpiderTestRng m_rng;
+  PositionTable m_table;
+  LegacyTable m_base;
+  LegacyTable m_velocity;
+  Vector m_nodePos;
+};
+
+SpiderBestAngleMobilityTestCase::SpiderBestAngleMobilityTestCase ()
+  : TestCase ("BestAngle with moving neighbours"),
+    m_rng (5)
+{
+}
+
+void
+SpiderBestAngleMobilityTestCase::Lookup (uint32_t step)
+{
+  double dt = Simulator::Now ().GetSeconds ();
+  LegacyTable legacy;
+  for (LegacyTable::const_iterator i = m_base.begin (); i != m_base.end (); i++)
+    {
+      Vector v = m_velocity[i->first];
+      legacy[i->first] = Vector (i->second.x + v.x * dt, i->second.y + v.y * dt, 0);
+    }
+  for (uint32_t lookup = 0; lookup < 3; lookup++)
+    {
+      Vector previousHop = GridPoint (m_rng);
+      if (previousHop.x == m_nodePos.x && previousHop.y == m_nodePos.y)
+        {
+          continue;
+        }
+      NS_TEST_EXPECT_MSG_EQ (m_table.BestAngle (previousHop, m_nodePos),
+                             LegacyBestAngle (legacy, previousHop, m_nodePos),
+                             "step " << step << " lookup " << lookup);
+    }
+}
+
+void
+SpiderBestAngleMobilityTestCase::DoRun (void)
+{
+  m_nodePos = Vector (0, 0, 0);
+  for (uint32_t i = 0; i < 25; i++)
+    {
+      Ipv4Address id (0x0a000001 + i);
+      Vector position = GridPoint (m_rng);
+      // a third of the neighbours stand still
+      Vector velocity;
+      if (i % 3 != 0)
+        {
+          velocity = Vector (m_rng.Integer (9) - 4.0, m_rng.Integer (9) - 4.0, 0);
+        }
+      m_table.AddEntry (id, position, velocity, m_nodePos, Vector (), Seconds (100), 0);
+      m_base[id] = position;
+      m_velocity[id] = velocity;
+    }
+  for (uint32_t step = 0; step < 40; step++)
+    {
+      Simulator::Schedule (Seconds (0.5 * step), &SpiderBestAngleMobilityTestCase::Lookup, this, step);
+    }
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+/**
+ * \ingroup spider
+ * \brief The AVX2 path of RhrPseudoAngles matches the scalar loop bit for bit
+ */
+class SpiderRhrAngleIsaTestCase : public TestCase
+{
+public:
+  SpiderRhrAngleIsaTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpiderRhrAngleIsaTestCase::SpiderRhrAngleIsaTestCase ()
+  : TestCase ("RHR pseudo-angles on every instruction set")
+{
+}
+
+void
+SpiderRhrAngleIsaTestCase::DoRun (void)
+{
+  SpiderTestRng rng (3);
+  for (uint32_t n = 0; n < 38; n++)
+    {
+      Vector centre = GridPoint (rng);
+      Vector ref = GridPoint (rng);
+      // one array of each length, so every tail of the vector loop shows up
+      std::vector<double> x (n + 1), y (n + 1);
+      for (uint32_t i = 0; i < n; i++)
+        {
+          switch (rng.Integer (5))
+            {
+            case 0:   // degenerate edge
+              x[i] = centre.x;
+              y[i] = centre.y;
+              break;
+            case 1:   // along or against the reference edge
+              x[i] = centre.x + (rng.Integer (5) - 2.0) * (ref.x - centre.x);
+              y[i] = centre.y + (rng.Integer (5) - 2.0) * (ref.y - centre.y);
+              break;
+            case 2:
+              x[i] = GridPoint (rng).x;
+              y[i] = GridPoint (rng).y;
+              break;
+            default:
+              x[i] = rng.Uniform (-1e4, 1e4);
+              y[i] = rng.Uniform (-1e4, 1e4);
+              break;
+            }
+        }
+      std::vector<double> scalar (n + 1), vector (n + 1);
+      SetKernelIsa (KERNEL_ISA_SCALAR);
+      RhrPseudoAngles (&x[0], &y[0], n, centre.x, centre.y, ref.x, ref.y, &scalar[0]);
+      SetKernelIsa (GetSupportedKernelIsa ());
+      RhrPseudoAngles (&x[0], &y[0], n, centre.x, centre.y, ref.x, ref.y, &vector[0]);
+      NS_TEST_ASSERT_MSG_EQ (std::memcmp (&scalar[0], &vector[0], n * sizeof (double)), 0,
+                             "paths differ for " << n << " neighbours");
+    }
+}
+
+/**
+ * \ingroup spider
+ * \brief The salvage copies are matched to MAC reports by packet uid
+ */
+class SpiderSalvageQueueTestCase : public TestCase
+{
+public:
+  SpiderSalvageQueueTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpiderSalvageQueueTestCase::SpiderSalvageQueueTestCase ()
+  : TestCase ("salvage copies by packet uid")
+{
+}
+
+void
+SpiderSalvageQueueTestCase::DoRun (void)
+{
+  SalvageQueue salvage (3, Seconds (1));
+  Ipv4Address a (0x0a000001);
+  Ipv4Address b (0x0a000002);
+  std::vector<Ptr<Packet> > packets;
+  for (uint32_t i = 0; i < 6; i++)
+    {
+      packets.push_back (Create<Packet> (100));
+      QueueEntry entry (packets[i]->Copy (), Ipv4Header ());
+      salvage.Enqueue (i < 4 ? a : b, entry);
+    }
+
+  Ipv4Address nextHop;
+  NS_TEST_ASSERT_MSG_EQ (salvage.Find (packets[0]->GetUid (), nextHop), false,
+                         "the oldest copy of a full queue is forgotten");
+  NS_TEST_ASSERT_MSG_EQ (salvage.Find (packets[4]->GetUid (), nextHop), true, "copy kept");
+  NS_TEST_ASSERT_MSG_EQ (nextHop, b, "next hop of the copy");
+
+  // a report for a packet without a copy changes nothing
+  salvage.Acknowledge (packets[0]->GetUid ());
+  salvage.Acknowledge (Create<Packet> ()->GetUid ());
+  // the MAC delivered the second frame to a before the first
+  salvage.Acknowledge (packets[2]->GetUid ());
+  NS_TEST_ASSERT_MSG_EQ (salvage.Find (packets[2]->GetUid (), nextHop), false, "acknowledged copy");
+
+  std::vector<QueueEntry> entries;
+  salvage.DequeueAll (a, entries);
+  NS_TEST_ASSERT_MSG_EQ (entries.size (), 2, "copies left for a");
+  NS_TEST_ASSERT_MSG_EQ (entries[0].GetPacket ()->GetUid (), packets[1]->GetUid (), "oldest first");
+  NS_TEST_ASSERT_MSG_EQ (entries[1].GetPacket ()->GetUid (), packets[3]->GetUid (), "then the next");
+  NS_TEST_ASSERT_MSG_EQ (salvage.Find (packets[1]->GetUid (), nextHop), false, "dequeued copy");
+  NS_TEST_ASSERT_MSG_EQ (salvage.Find (packets[5]->GetUid (), nextHop), true, "copies of b stay");
+
+  salvage.Acknowledge (packets[4]->GetUid ());
+  salvage.Acknowledge (packets[5]->GetUid ());
+  NS_TEST_ASSERT_MSG_EQ (salvage.IsEmpty (), true, "every copy acknowledged or dequeued");
+}
+
+/**
+ * \ingroup spider
+ * \brief Aggregate frames built by AggregationQueue::Pack and split by AggregationQueue::Unpack
+ *
+ * Covers one and many subframes, the sender stripped from the DataHeader of
+ * every packet, and truncated or corrupt frames, which must be rejected
+ * without reading past the subframe.
+ */
+class SpiderAggregateFrameTestCase : public TestCase
+{
+public:
+  SpiderAggregateFrameTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Data packet of n payload bytes, tagged with the seed, and its IPv4 header
+  QueueEntry MakeEntry (uint32_t seed, uint32_t n, Ipv4Address sender = Ipv4Address::GetZero ()) const;
+  /// Checks that entry carries the packet and header of expected
+  void CheckEntry (QueueEntry const & entry, QueueEntry const & expected, uint32_t i);
+  /// The bytes of p
+  static std::vector<uint8_t> Bytes (Ptr<const Packet> p);
+};
+
+SpiderAggregateFrameTestCase::SpiderAggregateFrameTestCase ()
+  : TestCase ("aggregate frames round trip")
+{
+}
+
+QueueEntry
+SpiderAggregateFrameTestCase::MakeEntry (uint32_t seed, uint32_t n, Ipv4Address sender) const
+{
+  std::vector<uint8_t> payload (n + 1);
+  for (uint32_t k = 0; k < payload.size (); k++)
+    {
+      payload[k] = (uint8_t) (seed * 31 + k);
+    }
+  // SPIDER aggregates only the packets it forwards, each with its DataHeader
+  Ptr<Packet> p = Create<Packet> (&payload[0], n);
+  PositionHeader position (Vector (120 + seed, -35, 4), seed, Vector (), 0, Vector (80, 10, 2));
+  position.SetSender (sender);
+  p->AddHeader (DataHeader (position));
+  Ipv4Header header;
+  header.SetSource (Ipv4Address (0x0a000001 + seed));
+  header.SetDestination (Ipv4Address (0x0a010001 + seed));
+  header.SetTtl ((uint8_t) (64 - seed % 32));
+  header.SetProtocol (17);
+  header.SetPayloadSize (p->GetSize ());
+  return QueueEntry (p, header);
+}
+
+std::vector<uint8_t>
+SpiderAggregateFrameTestCase::Bytes (Ptr<const Packet> p)
+{
+  std::vector<uint8_t> bytes (p->GetSize () + 1);
+  p->CopyData (&bytes[0], p->GetSize ());
+  bytes.resize (p->GetSize ());
+  return bytes;
+}
+
+void
+SpiderAggregateFrameTestCase::CheckEntry (QueueEntry const & entry, QueueEntry const & expected, uint32_t i)
+{
+  Ipv4Header header = entry.GetIpv4Header ();
+  Ipv4Header sent = expected.GetIpv4Header ();
+  NS_TEST_EXPECT_MSG_EQ (header.GetSource (), sent.GetSource (), "source of packet " << i);
+  NS_TEST_EXPECT_MSG_EQ (header.GetDestination (), sent.GetDestination (), "destination of packet " << i);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) header.GetTtl (), (uint32_t) sent.GetTtl (), "TTL of packet " << i);
+  NS_TEST_EXPECT_MSG_EQ ((uint32_t) header.GetProtocol (), (uint32_t) sent.GetProtocol (), "protocol of packet " << i);
+  NS_TEST_EXPECT_MSG_EQ (header.GetPayloadSize (), entry.GetPacket ()->GetSize (), "payload size of packet " << i);
+  NS_TEST_EXPECT_MSG_EQ ((Bytes (entry.GetPacket ()) == Bytes (expected.GetPacket ())), true,
+                         "bytes of packet " << i);
+}
+
+void
+SpiderAggregateFrameTestCase::DoRun (void)
+{
+  // one subframe
+  std::vector<QueueEntry> sent;
+  sent.push_back (MakeEntry (0, 48));
+  Ptr<Packet> frame = AggregationQueue::Pack (sent);
+  NS_TEST_ASSERT_MSG_EQ (frame->GetSize (), AggregationQueue::GetSubframeSize (sent[0]),
+                         "a subframe takes what the batch counted for it");
+  std::vector<QueueEntry> received;
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (frame, received), true, "one subframe");
+  NS_TEST_ASSERT_MSG_EQ (received.size (), 1, "one packet");
+  CheckEntry (received[0], sent[0], 0);
+
+  // many subframes, empty payloads included, in the order they were packed
+  sent.clear ();
+  uint32_t bytes = 0;
+  SpiderTestRng rng (25);
+  for (uint32_t i = 0; i < 40; i++)
+    {
+      sent.push_back (MakeEntry (i, i % 8 == 0 ? 0 : rng.Integer (300)));
+      bytes += AggregationQueue::GetSubframeSize (sent.back ());
+    }
+  frame = AggregationQueue::Pack (sent);
+  NS_TEST_ASSERT_MSG_EQ (frame->GetSize (), bytes, "subframes take what the batch counted for them");
+  received.clear ();
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (frame, received), true, "many subframes");
+  NS_TEST_ASSERT_MSG_EQ (received.size (), sent.size (), "every packet");
+  for (uint32_t i = 0; i < sent.size (); i++)
+    {
+      CheckEntry (received[i], sent[i], i);
+    }
+
+  // the frame carries the sender once, the packets lose theirs
+  Ipv4Address sender (0x0a0000fe);
+  std::vector<QueueEntry> greedy;
+  bytes = 0;
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      greedy.push_back (MakeEntry (i, 16 * i, sender));
+      bytes += AggregationQueue::GetSubframeSize (MakeEntry (i, 16 * i));
+    }
+  frame = AggregationQueue::Pack (greedy);
+  NS_TEST_ASSERT_MSG_EQ (frame->GetSize (), bytes, "subframes without the sender");
+  received.clear ();
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (frame, received), true, "subframes stripped of the sender");
+  NS_TEST_ASSERT_MSG_EQ (received.size (), greedy.size (), "every packet");
+  for (uint32_t i = 0; i < received.size (); i++)
+    {
+      DataHeader data;
+      received[i].GetPacket ()->PeekHeader (data);
+      NS_TEST_ASSERT_MSG_EQ (data.IsValid (), true, "DataHeader of packet " << i);
+      NS_TEST_EXPECT_MSG_EQ (data.GetPosition ().HasSender (), false, "sender of packet " << i);
+      CheckEntry (received[i], MakeEntry (i, 16 * i), i);
+    }
+  DataHeader original;
+  greedy[0].GetPacket ()->PeekHeader (original);
+  NS_TEST_EXPECT_MSG_EQ (original.GetPosition ().GetSender (), sender, "the packets held keep their sender");
+
+  // truncated: the packets before the cut survive
+  frame = AggregationQueue::Pack (sent);
+  uint32_t cut = AggregationQueue::GetSubframeSize (sent.back ()) - 1;
+  frame->RemoveAtEnd (cut);
+  received.clear ();
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (frame, received), false, "truncated frame");
+  NS_TEST_ASSERT_MSG_EQ (received.size (), sent.size () - 1, "packets before the cut");
+  for (uint32_t i = 0; i < received.size (); i++)
+    {
+      CheckEntry (received[i], sent[i], i);
+    }
+  frame->RemoveAtEnd (1);
+  received.clear ();
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (frame, received), true, "cut between subframes");
+  NS_TEST_ASSERT_MSG_EQ (received.size (), sent.size () - 1, "packets before the cut");
+  frame->AddAtEnd (Create<Packet> (1));
+  received.clear ();
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (frame, received), false, "a byte after the last subframe");
+
+  // a subframe too short for its IPv4 header is rejected before it is read
+  frame = AggregationQueue::Pack (std::vector<QueueEntry> (1, MakeEntry (1, 8)));
+  // 12 bytes of an IPv4 header, reading the header would run past the subframe
+  Ptr<Packet> runt = AggregationQueue::Pack (std::vector<QueueEntry> (1, MakeEntry (3, 8)))->CreateFragment (2, 12);
+  runt->AddHeader (SubframeHeader (12));
+  frame->AddAtEnd (runt);
+  frame->AddAtEnd (AggregationQueue::Pack (std::vector<QueueEntry> (1, MakeEntry (2, 8))));
+  received.clear ();
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (frame, received), false, "short subframe");
+  NS_TEST_ASSERT_MSG_EQ (received.size (), 1, "packets before the short subframe");
+  CheckEntry (received[0], MakeEntry (1, 8), 0);
+  received.clear ();
+  NS_TEST_ASSERT_MSG_EQ (AggregationQueue::Unpack (runt, received), false, "only a short subframe");
+  NS_TEST_ASSERT_MSG_EQ (received.size (), 0, "no packet");
+}
+
+/**
+ * \ingroup spider
+ * \brief SPIDER test suite
+ */
+class SpiderTestSuite : public TestSuite
+{
+public:
+  SpiderTestSuite ();
+};
+
+SpiderTestSuite::SpiderTestSuite ()
+  : TestSuite ("spider", UNIT)
+{
+  AddTestCase (new SpiderRhrAngleTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderBestAngleTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderBestAngleStackedTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderBestAngleMobilityTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderRhrAngleIsaTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderScoringRandomTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderScoringTieTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderSalvageQueueTestCase, TestCase::QUICK);
+  AddTestCase (new SpiderAggregateFrameTestCase, TestCase::QUICK);
+}
+
+static SpiderTestSuite g_spiderTestSuite; ///< the test suite
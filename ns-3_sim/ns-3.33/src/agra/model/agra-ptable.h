@@ -1,159 +0,0 @@
-/****************************************************************************/
-/* This file is part of AGRA project.                                       */
-/*                                                                          */
-/* AGRA is free software: you can redistribute it and/or modify             */
-/* it under the terms of the GNU General Public License as published by     */
-/* the Free Software Foundation, either version 3 of the License, or        */
-/* (at your option) any later version.                                      */
-/*                                                                          */
-/* AGRA is distributed in the hope that it will be useful,                  */
-/* but WITHOUT ANY WARRANTY; without even the implied warranty of           */
-/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
-/* GNU General Public License for more details.                             */
-/*                                                                          */
-/* You should have received a copy of the GNU General Public License        */
-/* along with AGRA.  If not, see <http://www.gnu.org/licenses/>.            */
-/*                                                                          */
-/****************************************************************************/
-/*                                                                          */
-/*  Author:    Dmitrii Chemodanov, University of Missouri-Columbia          */
-/*  Title:     AGRA: AI-augmented Geographic Routing Approach for IoT-based */
-/*             Incident-Supporting Applications                             */
-/*  Revision:  1.0         6/19/2017                                        */
-/****************************************************************************/
-#ifndef AGRA_PTABLE_H
-#define AGRA_PTABLE_H
-#define _DEFINE_DEPRECATED_HASH_CLASSES 0
-#include <map>
-#include <set>
-#include <cassert>
-#include <stdint.h>
-#include "ns3/ipv4.h"
-#include "ns3/timer.h"
-#include <sys/types.h>
-#include "ns3/node.h"
-#include "ns3/node-list.h"
-#include "ns3/mobility-model.h"
-#include "ns3/vector.h"
-#include "ns3/wifi-mac-header.h"
-#include "ns3/random-variable-stream.h"
-#include <complex>
-
-namespace ns3 {
-namespace agra {
-
-/*
- * \ingroup agra
- * \brief Position table used by AGRA
- */
-class PositionTable
-{
-public:
-  /// c-tor
-  PositionTable ();
-
-  /**
-   * \brief Gets the last time the entry was updated
-   * \param id Ipv4Address to get time of update from
-   * \return Time of last update to the position
-   */
-  Time GetEntryUpdateTime (Ipv4Address id);
-
-  /**
-   * \brief Adds entry in position table
-   */
-  void AddEntry (Ipv4Address id, Vector position);
-
-  /**
-   * \brief Deletes entry in position table
-   */
-  void DeleteEntry (Ipv4Address id);
-
-  /**
-   * \brief Gets position from position table
-   * \param id Ipv4Address to get position from
-   * \return Position of that id or NULL if not known
-   */
-  Vector GetPosition (Ipv4Address id);
-
-  /**
-   * \brief Checks if a node is a neighbour
-   * \param id Ipv4Address of the node to check
-   * \return True if the node is neighbour, false otherwise
-   */
-  bool isNeighbour (Ipv4Address id);
-
-  /**
-   * \brief remove entries with expired lifetime
-   */
-  void Purge ();
-
-  /**
-   * \brief clears all entries
-   */
-  void Clear ();
-
-  /**
-   * \Get Callback to ProcessTxError
-   */
-  Callback<void, WifiMacHeader const &> GetTxErrorCallback () const
-  {
-    return m_txErrorCallback;
-  }
-
-  void PrintNeighbors (std::ostream &os);
-
-  //Planarizes Graph by RNG
-  void PlanarizeNeighbors(Vector nodePos);
-
-  /**
-   * \brief Gets next hop according to AGRA protocol
-   * \param position the position of the destination node
-   * \param nodePos the position of the node that has the packet
-   * \return Ipv4Address of the next hop, Ipv4Address::GetZero () if no nighbour was found in greedy mode
-   */
-  Ipv4Address BestNeighbor (Vector position, Vector nodePos);
-
-  /**
-   * \brief Gets next hop according to Electrostatics based Greedy Forwarding
-   * \param position the position of the destination node
-   * \param nodePos the position of the node that has the packet
-   * \return Ipv4Address of the next hop, Ipv4Address::GetZero () if no nighbour was found in Repulsion mode
-   */
-  Ipv4Address ElectrostaticBestNeighbor (Vector position, Vector nodePos, double locationX, double locationY, double radius);
-
-  bool IsInSearch (Ipv4Address id);
-
-  bool HasPosition (Ipv4Address id);
-
-  static Vector GetInvalidPosition ()
-  {
-    return Vector (-1, -1, 0);
-  }
-
-  /**
-   * \brief Gets next hop according to AGRA recovery-mode protocol (right hand rule)
-   * \param previousHop the position of the node that sent the packet to this node
-   * \param nodePos the position of the destination node
-   * \return Ipv4Address of the next hop, Ipv4Address::GetZero () if no nighbour was found in greedy mode
-   */
-  Ipv4Address BestAngle (Vector previousHop, Vector nodePos);
-
-  //Gives angle between the vector CentrePos-Refpos to the vector CentrePos-node counterclockwise
-  double GetAngle (Vector centrePos, Vector refPos, Vector node);
-
-
-private:
-  Time m_entryLifeTime;
-  std::map<Ipv4Address, std::pair<Vector, Time> > m_table;
-  std::set<Ipv4Address> m_planarized_neighbors; //keeps set of prohibited neighbors IP addresses due graph planarization
-  // TX error callback
-  Callback<void, WifiMacHeader const &> m_txErrorCallback;
-  // Process layer 2 TX error notification
-  void ProcessTxError (WifiMacHeader const&);
-
-};
-
-}   // agra
-} // ns3
-#endif /* AGRA_PTABLE_H */
@@ -25,7 +25,8 @@
 #ifndef AGRA_H
 #define AGRA_H
 
-#include "agra-ptable.h"
+#include "ns3/spider-ptable.h"
+#include "ns3/spider-forwarding.h"
 #include "ns3/node.h"
 #include "agra-packet.h"
 #include "ns3/ipv4-routing-protocol.h"
@@ -46,6 +47,10 @@
 
 namespace ns3 {
 namespace agra {
+
+/// AGRA shares the neighbour table and the forwarding engine of SPIDER
+typedef spider::PositionTable PositionTable;
+
 /**
  * \ingroup agra
  *
@@ -116,6 +121,8 @@ public:
 private:
   /// Start protocol operation
   void Start ();
+  /// Obstacles of RepulsionMode: those of ObstacleFile, else the locationX, locationY, object_radius hole
+  Ptr<spider::ObstacleSet> GetObstacles () const;
   /// Queue packet and send route request
   void DeferredRouteOutput (Ptr<const Packet> p, const Ipv4Header & header, UnicastForwardCallback ucb, ErrorCallback ecb);
   /// If route exists and valid, forward packet.
@@ -147,11 +154,15 @@ private:
   Timer CheckQueueTimer;
   uint8_t LocationServiceName;
   PositionTable m_neighbors;
+  Ptr<spider::ForwardingEngineBase> m_engine;    ///< next-hop policies selected in Start ()
   bool PerimeterMode;
   //set 1 to use avoidance with EGF
   uint8_t RepulsionMode;
   //set location and radius of obstacle
   double locationX,locationY,object_radius;
+  //or load the obstacles from a file, acting up to ObstacleInfluence beyond their radius
+  std::string ObstacleFile;
+  double ObstacleInfluence;
   std::list<Ipv4Address> m_queuedAddresses;
   Ptr<LocationService> m_locationService;
 
@@ -0,0 +1,143 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+#include "node-directory.h"
+#include "ns3/log.h"
+#include "ns3/node-list.h"
+#include "ns3/ipv4.h"
+#include "ns3/simulator.h"
+
+NS_LOG_COMPONENT_DEFINE ("NodeDirectory");
+
+namespace ns3
+{
+
+NodeDirectory::Map &
+NodeDirectory::GetMap ()
+{
+  static Map map;
+  return map;
+}
+
+void
+NodeDirectory::Add (Ipv4Address address, Ptr<Node> node)
+{
+  NS_LOG_FUNCTION (address << node->GetId ());
+  Map &map = GetMap ();
+  if (map.empty ())
+    {
+      // release the node references together with the NodeList
+      Simulator::ScheduleDestroy (&NodeDirectory::Clear);
+    }
+  Entry &entry = map[address];
+  entry.node = node;
+  entry.mobility = node->GetObject<MobilityModel> ();
+  entry.index = node->GetId ();
+}
+
+void
+NodeDirectory::AddNode (Ptr<Node> node)
+{
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  if (ipv4 == 0)
+    {
+      return;
+    }
+  for (uint32_t i = 0; i < ipv4->GetNInterfaces (); i++)
+    {
+      for (uint32_t j = 0; j < ipv4->GetNAddresses (i); j++)
+        {
+          Ipv4Address address = ipv4->GetAddress (i, j).GetLocal ();
+          if (address != Ipv4Address::GetLoopback ())
+            {
+              Add (address, node);
+            }
+        }
+    }
+}
+
+void
+NodeDirectory::Remove (Ipv4Address address)
+{
+  NS_LOG_FUNCTION (address);
+  GetMap ().erase (address);
+}
+
+void
+NodeDirectory::Clear ()
+{
+  GetMap ().clear ();
+}
+
+const NodeDirectory::Entry *
+NodeDirectory::Find (Ipv4Address address)
+{
+  Map &map = GetMap ();
+  Map::iterator i = map.find (address);
+  if (i != map.end ())
+    {
+      return &i->second;
+    }
+  return Resolve (address);
+}
+
+NodeDirectory::Entry *
+NodeDirectory::Resolve (Ipv4Address address)
+{
+  uint32_t n = NodeList::GetNNodes ();
+  for (uint32_t i = 0; i < n; i++)
+    {
+      Ptr<Node> node = NodeList::GetNode (i);
+      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+      if (ipv4 == 0)
+        {
+          continue;
+        }
+      for (uint32_t k = 0; k < ipv4->GetNInterfaces (); k++)
+        {
+          for (uint32_t j = 0; j < ipv4->GetNAddresses (k); j++)
+            {
+              if (ipv4->GetAddress (k, j).GetLocal () == address)
+                {
+                  Add (address, node);
+                  return &GetMap ()[address];
+                }
+            }
+        }
+    }
+  return 0;
+}
+
+Ptr<Node>
+NodeDirectory::GetNode (Ipv4Address address)
+{
+  const Entry *entry = Find (address);
+  return entry ? entry->node : Ptr<Node> ();
+}
+
+Ptr<MobilityModel>
+NodeDirectory::GetMobility (Ipv4Address address)
+{
+  Entry *entry = const_cast<Entry *> (Find (address));
+  if (entry == 0)
+    {
+      return 0;
+    }
+  if (entry->mobility == 0)
+    {
+      entry->mobility = entry->node->GetObject<MobilityModel> ();
+    }
+  return entry->mobility;
+}
+
+bool
+NodeDirectory::GetPosition (Ipv4Address address, Vector &position)
+{
+  Ptr<MobilityModel> mobility = GetMobility (address);
+  if (mobility == 0)
+    {
+      return false;
+    }
+  position = mobility->GetPosition ();
+  return true;
+}
+
+}
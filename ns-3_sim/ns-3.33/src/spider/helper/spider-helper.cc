@@ -31,6 +31,7 @@
 #include "ns3/callback.h"
 #include "ns3/udp-l4-protocol.h"
 #include "ns3/tcp-l4-protocol.h"
+#include "ns3/node-directory.h"
 
 namespace ns3 {
 
@@ -74,6 +75,7 @@ SpiderHelper::Install (void) const
       Ptr<UdpL4Protocol> udp = node->GetObject<UdpL4Protocol> ();
       Ptr<TcpL4Protocol> tcp = node->GetObject<TcpL4Protocol> ();
       Ptr<spider::RoutingProtocol> spider = node->GetObject<spider::RoutingProtocol> ();
+      NodeDirectory::AddNode (node);
       //Ptr<LocationService> lS = CreateObject<GodLocationService>();
       //spider->SetLS(lS);
       spider->SetUdpDownTarget (udp->GetDownTarget ());
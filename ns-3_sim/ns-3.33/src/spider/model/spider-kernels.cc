@@ -0,0 +1,651 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/****************************************************************************/
+/* This file is part of SPIDER project.                                       */
+/*                                                                          */
+/* SPIDER is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by     */
+/* the Free Software Foundation, either version 3 of the License, or        */
+/* (at your option) any later version.                                      */
+/*                                                                          */
+/* SPIDER is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of           */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
+/* GNU General Public License for more details.                             */
+/*                                                                          */
+/* You should have received a copy of the GNU General Public License        */
+/* along with SPIDER.  If not, see <http://www.gnu.org/licenses/>.            */
+/*                                                                          */
+/****************************************************************************/
+/*                                                                          */
+/*  Author:    Dmitrii Chemodanov, University of Missouri-Columbia          */
+/*  Title:     SPIDER: AI-augmented Geographic Routing Approach for IoT-based */
+/*             Incident-Supporting Applications                             */
+/*  Revision:  1.0         6/19/2017                                        */
+/****************************************************************************/
+#include "spider-kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPIDER_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Every kernel has a scalar loop that also finishes the tail of the vector
+ * paths. The vector paths perform the same IEEE operations in the same order
+ * (no FMA contraction, FMA is not enabled by the target attributes), so all
+ * paths return bitwise identical results and the selection does not depend on
+ * the CPU the simulation runs on.
+ */
+
+namespace ns3 {
+namespace spider {
+
+namespace {
+
+KernelIsa
+DetectIsa ()
+{
+#ifdef SPIDER_KERNELS_X86
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      return KERNEL_ISA_AVX2;
+    }
+  if (__builtin_cpu_supports ("sse2"))
+    {
+      return KERNEL_ISA_SSE2;
+    }
+#endif
+  return KERNEL_ISA_SCALAR;
+}
+
+/// The path in use, see SetKernelIsa
+KernelIsa &
+GetIsa ()
+{
+  static KernelIsa isa = DetectIsa ();
+  return isa;
+}
+
+const double INF = std::numeric_limits<double>::infinity ();
+
+/*
+ * The pseudo-angle of the vector (X, Y) = (dot, cross) of the two edges is
+ * the "diamond angle": base + t / (|X| + |Y|) where base is the quadrant
+ * (0..3, counterclockwise from +X) and t is |Y| in even quadrants and |X| in
+ * odd ones. It orders angles exactly like atan2 without calling it.
+ */
+inline double
+RhrPseudoAngle (double bx, double by, double cx, double cy)
+{
+  double X = bx * cx + by * cy;
+  double Y = bx * cy - by * cx;
+  double ax = std::fabs (X);
+  double ay = std::fabs (Y);
+  double s = ax + ay;
+  if (!(s > 0))
+    {
+      return 0;
+    }
+  bool negX = X < 0;
+  bool negY = Y < 0;
+  double base = (negY ? 2.0 : 0.0) + (negX != negY ? 1.0 : 0.0);
+  double t = (negX != negY) ? ax : ay;
+  return base + t / s;
+}
+
+void
+RhrPseudoAnglesScalar (const double *x, const double *y, uint32_t begin, uint32_t n,
+                       double centreX, double centreY, double cx, double cy,
+                       double *angle)
+{
+  for (uint32_t i = begin; i < n; i++)
+    {
+      angle[i] = RhrPseudoAngle (x[i] - centreX, y[i] - centreY, cx, cy);
+    }
+}
+
+inline void
+Accumulate (double metric, double energy, double bound, ScoreRanges &r, uint32_t &count)
+{
+  if (metric < bound)
+    {
+      r.minMetric = std::min (r.minMetric, metric);
+      r.maxMetric = std::max (r.maxMetric, metric);
+      r.minEnergy = std::min (r.minEnergy, energy);
+      r.maxEnergy = std::max (r.maxEnergy, energy);
+      count++;
+    }
+}
+
+inline double
+Distance (double px, double py, double pz, double tx, double ty, double tz)
+{
+  double dx = px - tx;
+  double dy = py - ty;
+  double dz = pz - tz;
+  return std::sqrt (dx * dx + dy * dy + dz * dz);
+}
+
+uint32_t
+DistanceRangesScalar (const double *x, const double *y, const double *z,
+                      const double *energy, uint32_t begin, uint32_t n,
+                      double tx, double ty, double tz, double bound,
+                      double *metric, ScoreRanges &r)
+{
+  uint32_t count = 0;
+  for (uint32_t i = begin; i < n; i++)
+    {
+      metric[i] = Distance (x[i], y[i], z[i], tx, ty, tz);
+      Accumulate (metric[i], energy[i], bound, r, count);
+    }
+  return count;
+}
+
+uint32_t
+PotentialRangesScalar (const double *x, const double *y, const double *z,
+                       const double *energy, uint32_t begin, uint32_t n,
+                       double tx, double ty, double tz, double q,
+                       const PointCharges &c, double bound,
+                       double *metric, ScoreRanges &r)
+{
+  uint32_t count = 0;
+  for (uint32_t i = begin; i < n; i++)
+    {
+      metric[i] = Potential (x[i], y[i], z[i], tx, ty, tz, q, c);
+      Accumulate (metric[i], energy[i], bound, r, count);
+    }
+  return count;
+}
+
+double
+LambdaObjectiveScalar (double *metric, const double *energy, uint32_t begin, uint32_t n,
+                       double bound, double lamda, const ScoreRanges &r)
+{
+  double metricRange = r.maxMetric - r.minMetric;
+  double energyRange = r.maxEnergy - r.minEnergy;
+  double oneMinusLamda = 1 - lamda;
+  double minObj = INF;
+  for (uint32_t i = begin; i < n; i++)
+    {
+      if (!(metric[i] < bound))
+        {
+          metric[i] = INF;
+          continue;
+        }
+      double m = metricRange > 0 ? (metric[i] - r.minMetric) / metricRange : 0;
+      double e = energyRange > 0 ? (energy[i] - r.minEnergy) / energyRange : 0;
+      metric[i] = lamda * m + oneMinusLamda * -e;
+      minObj = std::min (minObj, metric[i]);
+    }
+  return minObj;
+}
+
+#ifdef SPIDER_KERNELS_X86
+
+/* SSE2 has no blendv, so masks are applied with and/andnot/or on both paths. */
+
+__attribute__ ((target ("sse2"))) inline __m128d
+Select128 (__m128d mask, __m128d a, __m128d b)
+{
+  return _mm_or_pd (_mm_and_pd (mask, a), _mm_andnot_pd (mask, b));
+}
+
+__attribute__ ((target ("sse2"))) inline double
+HMin128 (__m128d v)
+{
+  return std::min (_mm_cvtsd_f64 (v), _mm_cvtsd_f64 (_mm_unpackhi_pd (v, v)));
+}
+
+__attribute__ ((target ("sse2"))) inline double
+HMax128 (__m128d v)
+{
+  return std::max (_mm_cvtsd_f64 (v), _mm_cvtsd_f64 (_mm_unpackhi_pd (v, v)));
+}
+
+__attribute__ ((target ("sse2"))) inline uint32_t
+Ranges128 (__m128d metric, __m128d energy, __m128d bound,
+           __m128d &minM, __m128d &maxM, __m128d &minE, __m128d &maxE)
+{
+  const __m128d inf = _mm_set1_pd (INF);
+  const __m128d ninf = _mm_set1_pd (-INF);
+  __m128d cand = _mm_cmplt_pd (metric, bound);
+  minM = _mm_min_pd (minM, Select128 (cand, metric, inf));
+  maxM = _mm_max_pd (maxM, Select128 (cand, metric, ninf));
+  minE = _mm_min_pd (minE, Select128 (cand, energy, inf));
+  maxE = _mm_max_pd (maxE, Select128 (cand, energy, ninf));
+  return __builtin_popcount (_mm_movemask_pd (cand));
+}
+
+__attribute__ ((target ("sse2"))) void
+StoreRanges128 (__m128d minM, __m128d maxM, __m128d minE, __m128d maxE, ScoreRanges &r)
+{
+  r.minMetric = std::min (r.minMetric, HMin128 (minM));
+  r.maxMetric = std::max (r.maxMetric, HMax128 (maxM));
+  r.minEnergy = std::min (r.minEnergy, HMin128 (minE));
+  r.maxEnergy = std::max (r.maxEnergy, HMax128 (maxE));
+}
+
+__attribute__ ((target ("sse2"))) uint32_t
+DistanceRangesSse2 (const double *x, const double *y, const double *z,
+                    const double *energy, uint32_t n,
+                    double tx, double ty, double tz, double bound,
+                    double *metric, ScoreRanges &r, uint32_t &count)
+{
+  const __m128d vtx = _mm_set1_pd (tx);
+  const __m128d vty = _mm_set1_pd (ty);
+  const __m128d vtz = _mm_set1_pd (tz);
+  const __m128d vbound = _mm_set1_pd (bound);
+  __m128d minM = _mm_set1_pd (INF), maxM = _mm_set1_pd (-INF);
+  __m128d minE = minM, maxE = maxM;
+  uint32_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    {
+      __m128d dx = _mm_sub_pd (_mm_loadu_pd (x + i), vtx);
+      __m128d dy = _mm_sub_pd (_mm_loadu_pd (y + i), vty);
+      __m128d dz = _mm_sub_pd (_mm_loadu_pd (z + i), vtz);
+      __m128d d = _mm_sqrt_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (dx, dx), _mm_mul_pd (dy, dy)),
+                                           _mm_mul_pd (dz, dz)));
+      _mm_storeu_pd (metric + i, d);
+      count += Ranges128 (d, _mm_loadu_pd (energy + i), vbound, minM, maxM, minE, maxE);
+    }
+  StoreRanges128 (minM, maxM, minE, maxE, r);
+  return i;
+}
+
+__attribute__ ((target ("sse2"))) uint32_t
+PotentialRangesSse2 (const double *x, const double *y, const double *z,
+                     const double *energy, uint32_t n,
+                     double tx, double ty, double tz, double q,
+                     const PointCharges &c, double bound,
+                     double *metric, ScoreRanges &r, uint32_t &count)
+{
+  const __m128d vtx = _mm_set1_pd (tx);
+  const __m128d vty = _mm_set1_pd (ty);
+  const __m128d vtz = _mm_set1_pd (tz);
+  const __m128d vnq = _mm_set1_pd (-q);
+  const __m128d vbound = _mm_set1_pd (bound);
+  __m128d minM = _mm_set1_pd (INF), maxM = _mm_set1_pd (-INF);
+  __m128d minE = minM, maxE = maxM;
+  uint32_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    {
+      __m128d px = _mm_loadu_pd (x + i);
+      __m128d py = _mm_loadu_pd (y + i);
+      __m128d pz = _mm_loadu_pd (z + i);
+      __m128d dx = _mm_sub_pd (px, vtx);
+      __m128d dy = _mm_sub_pd (py, vty);
+      __m128d dz = _mm_sub_pd (pz, vtz);
+      __m128d d = _mm_sqrt_pd (_mm_add_pd (_mm_add_pd (_mm_mul_pd (dx, dx), _mm_mul_pd (dy, dy)),
+                                           _mm_mul_pd (dz, dz)));
+      __m128d p = _mm_div_pd (vnq, d);
+      for (uint32_t k = 0; k < c.n; k++)
+        {
+          __m128d hdx = _mm_sub_pd (px, _mm_set1_pd (c.x[k]));
+          __m128d hdy = _mm_sub_pd (py, _mm_set1_pd (c.y[k]));
+          __m128d hz = _mm_min_pd (_mm_max_pd (pz, _mm_set1_pd (c.z0[k])), _mm_set1_pd (c.z1[k]));
+          __m128d hdz = _mm_sub_pd (pz, hz);
+          __m128d d2 = _mm_add_pd (_mm_add_pd (_mm_mul_pd (hdx, hdx), _mm_mul_pd (hdy, hdy)),
+                                   _mm_mul_pd (hdz, hdz));
+          __m128d inReach = _mm_cmple_pd (d2, _mm_set1_pd (c.reach2[k]));
+          p = _mm_add_pd (p, Select128 (inReach, _mm_div_pd (_mm_set1_pd (c.q[k]), d2), _mm_setzero_pd ()));
+        }
+      _mm_storeu_pd (metric + i, p);
+      count += Ranges128 (p, _mm_loadu_pd (energy + i), vbound, minM, maxM, minE, maxE);
+    }
+  StoreRanges128 (minM, maxM, minE, maxE, r);
+  return i;
+}
+
+__attribute__ ((target ("sse2"))) uint32_t
+LambdaObjectiveSse2 (double *metric, const double *energy, uint32_t n,
+                     double bound, double lamda, const ScoreRanges &r, double &minObj)
+{
+  double metricRange = r.maxMetric - r.minMetric;
+  double energyRange = r.maxEnergy - r.minEnergy;
+  const __m128d zero = _mm_setzero_pd ();
+  const __m128d inf = _mm_set1_pd (INF);
+  const __m128d signMask = _mm_set1_pd (-0.0);
+  const __m128d vbound = _mm_set1_pd (bound);
+  const __m128d vl = _mm_set1_pd (lamda);
+  const __m128d v1l = _mm_set1_pd (1 - lamda);
+  const __m128d minM = _mm_set1_pd (r.minMetric);
+  const __m128d rangeM = _mm_set1_pd (metricRange);
+  const __m128d minE = _mm_set1_pd (r.minEnergy);
+  const __m128d rangeE = _mm_set1_pd (energyRange);
+  __m128d vmin = inf;
+  uint32_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    {
+      __m128d m = _mm_loadu_pd (metric + i);
+      __m128d cand = _mm_cmplt_pd (m, vbound);
+      __m128d nm = metricRange > 0 ? _mm_div_pd (_mm_sub_pd (m, minM), rangeM) : zero;
+      __m128d ne = energyRange > 0 ? _mm_div_pd (_mm_sub_pd (_mm_loadu_pd (energy + i), minE), rangeE) : zero;
+      __m128d obj = _mm_add_pd (_mm_mul_pd (vl, nm), _mm_mul_pd (v1l, _mm_xor_pd (ne, signMask)));
+      obj = Select128 (cand, obj, inf);
+      _mm_storeu_pd (metric + i, obj);
+      vmin = _mm_min_pd (obj, vmin);
+    }
+  minObj = std::min (minObj, HMin128 (vmin));
+  return i;
+}
+
+__attribute__ ((target ("avx2"))) inline __m256d
+Select256 (__m256d mask, __m256d a, __m256d b)
+{
+  return _mm256_blendv_pd (b, a, mask);
+}
+
+__attribute__ ((target ("avx2"))) inline double
+HMin256 (__m256d v)
+{
+  __m128d m = _mm_min_pd (_mm256_castpd256_pd128 (v), _mm256_extractf128_pd (v, 1));
+  return std::min (_mm_cvtsd_f64 (m), _mm_cvtsd_f64 (_mm_unpackhi_pd (m, m)));
+}
+
+__attribute__ ((target ("avx2"))) inline double
+HMax256 (__m256d v)
+{
+  __m128d m = _mm_max_pd (_mm256_castpd256_pd128 (v), _mm256_extractf128_pd (v, 1));
+  return std::max (_mm_cvtsd_f64 (m), _mm_cvtsd_f64 (_mm_unpackhi_pd (m, m)));
+}
+
+__attribute__ ((target ("avx2"))) inline uint32_t
+Ranges256 (__m256d metric, __m256d energy, __m256d bound,
+           __m256d &minM, __m256d &maxM, __m256d &minE, __m256d &maxE)
+{
+  const __m256d inf = _mm256_set1_pd (INF);
+  const __m256d ninf = _mm256_set1_pd (-INF);
+  __m256d cand = _mm256_cmp_pd (metric, bound, _CMP_LT_OQ);
+  minM = _mm256_min_pd (minM, Select256 (cand, metric, inf));
+  maxM = _mm256_max_pd (maxM, Select256 (cand, metric, ninf));
+  minE = _mm256_min_pd (minE, Select256 (cand, energy, inf));
+  maxE = _mm256_max_pd (maxE, Select256 (cand, energy, ninf));
+  return __builtin_popcount (_mm256_movemask_pd (cand));
+}
+
+__attribute__ ((target ("avx2"))) void
+StoreRanges256 (__m256d minM, __m256d maxM, __m256d minE, __m256d maxE, ScoreRanges &r)
+{
+  r.minMetric = std::min (r.minMetric, HMin256 (minM));
+  r.maxMetric = std::max (r.maxMetric, HMax256 (maxM));
+  r.minEnergy = std::min (r.minEnergy, HMin256 (minE));
+  r.maxEnergy = std::max (r.maxEnergy, HMax256 (maxE));
+}
+
+__attribute__ ((target ("avx2"))) uint32_t
+RhrPseudoAnglesAvx2 (const double *x, const double *y, uint32_t n,
+                     double centreX, double centreY, double cx, double cy,
+                     double *angle)
+{
+  const __m256d zero = _mm256_setzero_pd ();
+  const __m256d one = _mm256_set1_pd (1.0);
+  const __m256d two = _mm256_set1_pd (2.0);
+  const __m256d signMask = _mm256_set1_pd (-0.0);
+  const __m256d ox = _mm256_set1_pd (centreX);
+  const __m256d oy = _mm256_set1_pd (centreY);
+  const __m256d vcx = _mm256_set1_pd (cx);
+  const __m256d vcy = _mm256_set1_pd (cy);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256d bx = _mm256_sub_pd (_mm256_loadu_pd (x + i), ox);
+      __m256d by = _mm256_sub_pd (_mm256_loadu_pd (y + i), oy);
+      __m256d X = _mm256_add_pd (_mm256_mul_pd (bx, vcx), _mm256_mul_pd (by, vcy));
+      __m256d Y = _mm256_sub_pd (_mm256_mul_pd (bx, vcy), _mm256_mul_pd (by, vcx));
+      __m256d ax = _mm256_andnot_pd (signMask, X);
+      __m256d ay = _mm256_andnot_pd (signMask, Y);
+      __m256d s = _mm256_add_pd (ax, ay);
+      __m256d negX = _mm256_cmp_pd (X, zero, _CMP_LT_OQ);
+      __m256d negY = _mm256_cmp_pd (Y, zero, _CMP_LT_OQ);
+      __m256d odd = _mm256_xor_pd (negX, negY);
+      __m256d base = _mm256_add_pd (_mm256_and_pd (negY, two), _mm256_and_pd (odd, one));
+      __m256d t = _mm256_blendv_pd (ay, ax, odd);
+      __m256d a = _mm256_add_pd (base, _mm256_div_pd (t, s));
+      __m256d valid = _mm256_cmp_pd (s, zero, _CMP_GT_OQ);
+      _mm256_storeu_pd (angle + i, _mm256_and_pd (a, valid));
+    }
+  return i;
+}
+
+__attribute__ ((target ("avx2"))) uint32_t
+DistanceRangesAvx2 (const double *x, const double *y, const double *z,
+                    const double *energy, uint32_t n,
+                    double tx, double ty, double tz, double bound,
+                    double *metric, ScoreRanges &r, uint32_t &count)
+{
+  const __m256d vtx = _mm256_set1_pd (tx);
+  const __m256d vty = _mm256_set1_pd (ty);
+  const __m256d vtz = _mm256_set1_pd (tz);
+  const __m256d vbound = _mm256_set1_pd (bound);
+  __m256d minM = _mm256_set1_pd (INF), maxM = _mm256_set1_pd (-INF);
+  __m256d minE = minM, maxE = maxM;
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256d dx = _mm256_sub_pd (_mm256_loadu_pd (x + i), vtx);
+      __m256d dy = _mm256_sub_pd (_mm256_loadu_pd (y + i), vty);
+      __m256d dz = _mm256_sub_pd (_mm256_loadu_pd (z + i), vtz);
+      __m256d d = _mm256_sqrt_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (dx, dx), _mm256_mul_pd (dy, dy)),
+                                                 _mm256_mul_pd (dz, dz)));
+      _mm256_storeu_pd (metric + i, d);
+      count += Ranges256 (d, _mm256_loadu_pd (energy + i), vbound, minM, maxM, minE, maxE);
+    }
+  StoreRanges256 (minM, maxM, minE, maxE, r);
+  return i;
+}
+
+__attribute__ ((target ("avx2"))) uint32_t
+PotentialRangesAvx2 (const double *x, const double *y, const double *z,
+                     const double *energy, uint32_t n,
+                     double tx, double ty, double tz, double q,
+                     const PointCharges &c, double bound,
+                     double *metric, ScoreRanges &r, uint32_t &count)
+{
+  const __m256d vtx = _mm256_set1_pd (tx);
+  const __m256d vty = _mm256_set1_pd (ty);
+  const __m256d vtz = _mm256_set1_pd (tz);
+  const __m256d vnq = _mm256_set1_pd (-q);
+  const __m256d vbound = _mm256_set1_pd (bound);
+  __m256d minM = _mm256_set1_pd (INF), maxM = _mm256_set1_pd (-INF);
+  __m256d minE = minM, maxE = maxM;
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256d px = _mm256_loadu_pd (x + i);
+      __m256d py = _mm256_loadu_pd (y + i);
+      __m256d pz = _mm256_loadu_pd (z + i);
+      __m256d dx = _mm256_sub_pd (px, vtx);
+      __m256d dy = _mm256_sub_pd (py, vty);
+      __m256d dz = _mm256_sub_pd (pz, vtz);
+      __m256d d = _mm256_sqrt_pd (_mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (dx, dx), _mm256_mul_pd (dy, dy)),
+                                                 _mm256_mul_pd (dz, dz)));
+      __m256d p = _mm256_div_pd (vnq, d);
+      for (uint32_t k = 0; k < c.n; k++)
+        {
+          __m256d hdx = _mm256_sub_pd (px, _mm256_set1_pd (c.x[k]));
+          __m256d hdy = _mm256_sub_pd (py, _mm256_set1_pd (c.y[k]));
+          __m256d hz = _mm256_min_pd (_mm256_max_pd (pz, _mm256_set1_pd (c.z0[k])), _mm256_set1_pd (c.z1[k]));
+          __m256d hdz = _mm256_sub_pd (pz, hz);
+          __m256d d2 = _mm256_add_pd (_mm256_add_pd (_mm256_mul_pd (hdx, hdx), _mm256_mul_pd (hdy, hdy)),
+                                   _mm256_mul_pd (hdz, hdz));
+          __m256d inReach = _mm256_cmp_pd (d2, _mm256_set1_pd (c.reach2[k]), _CMP_LE_OQ);
+          p = _mm256_add_pd (p, Select256 (inReach, _mm256_div_pd (_mm256_set1_pd (c.q[k]), d2), _mm256_setzero_pd ()));
+        }
+      _mm256_storeu_pd (metric + i, p);
+      count += Ranges256 (p, _mm256_loadu_pd (energy + i), vbound, minM, maxM, minE, maxE);
+    }
+  StoreRanges256 (minM, maxM, minE, maxE, r);
+  return i;
+}
+
+__attribute__ ((target ("avx2"))) uint32_t
+LambdaObjectiveAvx2 (double *metric, const double *energy, uint32_t n,
+                     double bound, double lamda, const ScoreRanges &r, double &minObj)
+{
+  double metricRange = r.maxMetric - r.minMetric;
+  double energyRange = r.maxEnergy - r.minEnergy;
+  const __m256d zero = _mm256_setzero_pd ();
+  const __m256d inf = _mm256_set1_pd (INF);
+  const __m256d signMask = _mm256_set1_pd (-0.0);
+  const __m256d vbound = _mm256_set1_pd (bound);
+  const __m256d vl = _mm256_set1_pd (lamda);
+  const __m256d v1l = _mm256_set1_pd (1 - lamda);
+  const __m256d minM = _mm256_set1_pd (r.minMetric);
+  const __m256d rangeM = _mm256_set1_pd (metricRange);
+  const __m256d minE = _mm256_set1_pd (r.minEnergy);
+  const __m256d rangeE = _mm256_set1_pd (energyRange);
+  __m256d vmin = inf;
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256d m = _mm256_loadu_pd (metric + i);
+      __m256d cand = _mm256_cmp_pd (m, vbound, _CMP_LT_OQ);
+      __m256d nm = metricRange > 0 ? _mm256_div_pd (_mm256_sub_pd (m, minM), rangeM) : zero;
+      __m256d ne = energyRange > 0 ? _mm256_div_pd (_mm256_sub_pd (_mm256_loadu_pd (energy + i), minE), rangeE) : zero;
+      __m256d obj = _mm256_add_pd (_mm256_mul_pd (vl, nm), _mm256_mul_pd (v1l, _mm256_xor_pd (ne, signMask)));
+      obj = Select256 (cand, obj, inf);
+      _mm256_storeu_pd (metric + i, obj);
+      vmin = _mm256_min_pd (obj, vmin);
+    }
+  minObj = std::min (minObj, HMin256 (vmin));
+  return i;
+}
+
+#endif /* SPIDER_KERNELS_X86 */
+
+} // anonymous namespace
+
+KernelIsa
+GetSupportedKernelIsa ()
+{
+  static const KernelIsa isa = DetectIsa ();
+  return isa;
+}
+
+KernelIsa
+SetKernelIsa (KernelIsa isa)
+{
+  GetIsa () = std::min (isa, GetSupportedKernelIsa ());
+  return GetIsa ();
+}
+
+void
+RhrPseudoAngles (const double *x, const double *y, uint32_t n,
+                 double centreX, double centreY, double refX, double refY,
+                 double *angle)
+{
+  double cx = refX - centreX;
+  double cy = refY - centreY;
+  uint32_t done = 0;
+#ifdef SPIDER_KERNELS_X86
+  if (GetIsa () == KERNEL_ISA_AVX2)
+    {
+      done = RhrPseudoAnglesAvx2 (x, y, n, centreX, centreY, cx, cy, angle);
+    }
+#endif
+  RhrPseudoAnglesScalar (x, y, done, n, centreX, centreY, cx, cy, angle);
+}
+
+uint32_t
+DistanceRanges (const double *x, const double *y, const double *z,
+                const double *energy, uint32_t n,
+                double tx, double ty, double tz, double bound,
+                double *metric, ScoreRanges &ranges)
+{
+  ranges.minMetric = ranges.minEnergy = INF;
+  ranges.maxMetric = ranges.maxEnergy = -INF;
+  uint32_t count = 0;
+  uint32_t done = 0;
+#ifdef SPIDER_KERNELS_X86
+  switch (GetIsa ())
+    {
+    case KERNEL_ISA_AVX2:
+      done = DistanceRangesAvx2 (x, y, z, energy, n, tx, ty, tz, bound, metric, ranges, count);
+      break;
+    case KERNEL_ISA_SSE2:
+      done = DistanceRangesSse2 (x, y, z, energy, n, tx, ty, tz, bound, metric, ranges, count);
+      break;
+    default:
+      break;
+    }
+#endif
+  return count + DistanceRangesScalar (x, y, z, energy, done, n, tx, ty, tz, bound, metric, ranges);
+}
+
+double
+Potential (double px, double py, double pz,
+           double tx, double ty, double tz, double q,
+           const PointCharges &c)
+{
+  double p = -q / Distance (px, py, pz, tx, ty, tz);
+  for (uint32_t k = 0; k < c.n; k++)
+    {
+      double dx = px - c.x[k];
+      double dy = py - c.y[k];
+      double dz = pz - std::min (std::max (pz, c.z0[k]), c.z1[k]);
+      double d2 = dx * dx + dy * dy + dz * dz;
+      if (d2 <= c.reach2[k])
+        {
+          p = p + c.q[k] / d2;
+        }
+    }
+  return p;
+}
+
+uint32_t
+PotentialRanges (const double *x, const double *y, const double *z,
+                 const double *energy, uint32_t n,
+                 double tx, double ty, double tz, double q,
+                 const PointCharges &charges, double bound,
+                 double *metric, ScoreRanges &ranges)
+{
+  ranges.minMetric = ranges.minEnergy = INF;
+  ranges.maxMetric = ranges.maxEnergy = -INF;
+  uint32_t count = 0;
+  uint32_t done = 0;
+#ifdef SPIDER_KERNELS_X86
+  switch (GetIsa ())
+    {
+    case KERNEL_ISA_AVX2:
+      done = PotentialRangesAvx2 (x, y, z, energy, n, tx, ty, tz, q, charges,
+                                  bound, metric, ranges, count);
+      break;
+    case KERNEL_ISA_SSE2:
+      done = PotentialRangesSse2 (x, y, z, energy, n, tx, ty, tz, q, charges,
+                                  bound, metric, ranges, count);
+      break;
+    default:
+      break;
+    }
+#endif
+  return count + PotentialRangesScalar (x, y, z, energy, done, n, tx, ty, tz, q,
+                                        charges, bound, metric, ranges);
+}
+
+double
+LambdaObjective (double *metric, const double *energy, uint32_t n,
+                 double bound, double lamda, const ScoreRanges &ranges)
+{
+  double minObj = INF;
+  uint32_t done = 0;
+#ifdef SPIDER_KERNELS_X86
+  switch (GetIsa ())
+    {
+    case KERNEL_ISA_AVX2:
+      done = LambdaObjectiveAvx2 (metric, energy, n, bound, lamda, ranges, minObj);
+      break;
+    case KERNEL_ISA_SSE2:
+      done = LambdaObjectiveSse2 (metric, energy, n, bound, lamda, ranges, minObj);
+      break;
+    default:
+      break;
+    }
+#endif
+  return std::min (minObj, LambdaObjectiveScalar (metric, energy, done, n, bound, lamda, ranges));
+}
+
+}
+}
@@ -0,0 +1,403 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/****************************************************************************/
+/* This file is part of SPIDER project.                                       */
+/*                                                                          */
+/* SPIDER is free software: you can redistribute it and/or modify             */
+/* it under the terms of the GNU General Public License as published by     */
+/* the Free Software Foundation, either version 3 of the License, or        */
+/* (at your option) any later version.                                      */
+/*                                                                          */
+/* SPIDER is distributed in the hope that it will be useful,                  */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of           */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
+/* GNU General Public License for more details.                             */
+/*                                                                          */
+/* You should have received a copy of the GNU General Public License        */
+/* along with SPIDER.  If not, see <http://www.gnu.org/licenses/>.            */
+/*                                                                          */
+/****************************************************************************/
+/*                                                                          */
+/*  Author:    Dmitrii Chemodanov, University of Missouri-Columbia          */
+/*  Title:     SPIDER: AI-augmented Geographic Routing Approach for IoT-based */
+/*             Incident-Supporting Applications                             */
+/*  Revision:  1.0         6/19/2017                                        */
+/****************************************************************************/
+#include "spider-obstacles.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("SpiderObstacles");
+
+namespace spider {
+
+void
+ChargeList::Clear ()
+{
+  m_x.clear ();
+  m_y.clear ();
+  m_z0.clear ();
+  m_z1.clear ();
+  m_q.clear ();
+  m_reach2.clear ();
+}
+
+PointCharges
+ChargeList::Get () const
+{
+  PointCharges c;
+  c.n = m_q.size ();
+  c.x = c.n ? &m_x[0] : 0;
+  c.y = c.n ? &m_y[0] : 0;
+  c.z0 = c.n ? &m_z0[0] : 0;
+  c.z1 = c.n ? &m_z1[0] : 0;
+  c.q = c.n ? &m_q[0] : 0;
+  c.reach2 = c.n ? &m_reach2[0] : 0;
+  return c;
+}
+
+namespace {
+
+typedef std::map<std::pair<std::string, double>, Ptr<ObstacleSet> > ObstacleFiles;
+
+ObstacleFiles &
+GetObstacleFiles ()
+{
+  static ObstacleFiles files;
+  return files;
+}
+
+void
+ClearObstacleFiles ()
+{
+  GetObstacleFiles ().clear ();
+}
+
+/// Grid cell of coordinate v, clamped to -1..n so that far boxes do not overflow
+int32_t
+CellIndex (double v, double origin, double cellSize, int32_t n)
+{
+  double cell = std::floor ((v - origin) / cellSize);
+  return static_cast<int32_t> (std::max (-1.0, std::min (cell, static_cast<double> (n))));
+}
+
+} // anonymous namespace
+
+ObstacleSet::ObstacleSet ()
+  : m_influence (0),
+    m_q (0),
+    m_stamp (1),
+    m_indexValid (false),
+    m_originX (0),
+    m_originY (0),
+    m_cellSize (0),
+    m_nx (0),
+    m_ny (0),
+    m_query (0)
+{
+}
+
+Ptr<ObstacleSet>
+ObstacleSet::Load (std::string filename, double influence)
+{
+  ObstacleFiles &files = GetObstacleFiles ();
+  std::pair<std::string, double> key (filename, influence);
+  ObstacleFiles::iterator i = files.find (key);
+  if (i != files.end ())
+    {
+      return i->second;
+    }
+  if (files.empty ())
+    {
+      Simulator::ScheduleDestroy (&ClearObstacleFiles);
+    }
+  Ptr<ObstacleSet> obstacles = Create<ObstacleSet> ();
+  obstacles->SetInfluenceRadius (influence);
+  obstacles->ReadFile (filename);
+  files[key] = obstacles;
+  return obstacles;
+}
+
+void
+ObstacleSet::ReadFile (std::string filename)
+{
+  std::ifstream file (filename.c_str ());
+  if (!file.is_open ())
+    {
+      NS_FATAL_ERROR ("Cannot open obstacle file " << filename);
+    }
+  std::string line;
+  uint32_t lineNo = 0;
+  while (std::getline (file, line))
+    {
+      lineNo++;
+      std::string::size_type comment = line.find ('#');
+      if (comment != std::string::npos)
+        {
+          line.erase (comment);
+        }
+      std::istringstream is (line);
+      std::string kind;
+      if (!(is >> kind))
+        {
+          continue;     // blank line
+        }
+      std::vector<double> v;
+      double value;
+      while (is >> value)
+        {
+          v.push_back (value);
+        }
+      if (!is.eof ())
+        {
+          NS_FATAL_ERROR (filename << ":" << lineNo << ": not a number");
+        }
+      if (kind == "circle" && v.size () == 3 && v[2] > 0)
+        {
+          AddCircle (v[0], v[1], v[2]);
+        }
+      else if (kind == "cylinder" && v.size () == 5 && v[2] > 0 && v[3] <= v[4])
+        {
+          AddCylinder (v[0], v[1], v[2], v[3], v[4]);
+        }
+      else if (kind == "polygon" && v.size () >= 6 && v.size () % 2 == 0)
+        {
+          std::vector<Vector> vertices;
+          for (uint32_t k = 0; k < v.size (); k += 2)
+            {
+              vertices.push_back (Vector (v[k], v[k + 1], 0));
+            }
+          AddPolygon (vertices);
+        }
+      else
+        {
+          NS_FATAL_ERROR (filename << ":" << lineNo << ": malformed obstacle '" << kind << "'");
+        }
+    }
+  NS_LOG_DEBUG ("Read " << GetN () << " obstacles from " << filename);
+}
+
+void
+ObstacleSet::AddCircle (double x, double y, double radius)
+{
+  Add (x, y, radius, 0, 0);
+}
+
+void
+ObstacleSet::AddCylinder (double x, double y, double radius, double zMin, double zMax)
+{
+  Add (x, y, radius, zMin, zMax);
+}
+
+void
+ObstacleSet::AddPolygon (const std::vector<Vector> &vertices)
+{
+  NS_ASSERT (vertices.size () >= 3);
+  // area centroid by the shoelace formula, the vertex mean for degenerate polygons
+  double area = 0;
+  double cx = 0;
+  double cy = 0;
+  for (uint32_t k = 0; k < vertices.size (); k++)
+    {
+      const Vector &a = vertices[k];
+      const Vector &b = vertices[(k + 1) % vertices.size ()];
+      double cross = a.x * b.y - b.x * a.y;
+      area += cross;
+      cx += (a.x + b.x) * cross;
+      cy += (a.y + b.y) * cross;
+    }
+  if (std::fabs (area) > std::numeric_limits<double>::epsilon ())
+    {
+      cx /= 3 * area;
+      cy /= 3 * area;
+    }
+  else
+    {
+      cx = cy = 0;
+      for (uint32_t k = 0; k < vertices.size (); k++)
+        {
+          cx += vertices[k].x / vertices.size ();
+          cy += vertices[k].y / vertices.size ();
+        }
+    }
+  double radius = 0;
+  for (uint32_t k = 0; k < vertices.size (); k++)
+    {
+      radius = std::max (radius, std::sqrt ((vertices[k].x - cx) * (vertices[k].x - cx)
+                                            + (vertices[k].y - cy) * (vertices[k].y - cy)));
+    }
+  Add (cx, cy, radius, 0, 0);
+}
+
+void
+ObstacleSet::Add (double x, double y, double radius, double zMin, double zMax)
+{
+  m_x.push_back (x);
+  m_y.push_back (y);
+  m_zMin.push_back (zMin);
+  m_zMax.push_back (zMax);
+  m_radius.push_back (radius);
+  m_charge.push_back (0);
+  m_chargeStamp.push_back (0);
+  m_seen.push_back (0);
+  m_indexValid = false;
+}
+
+void
+ObstacleSet::SetInfluenceRadius (double influence)
+{
+  m_influence = influence;
+  m_indexValid = false;
+}
+
+void
+ObstacleSet::BuildIndex ()
+{
+  m_indexValid = true;
+  m_cells.clear ();
+  m_nx = m_ny = 0;
+  if (m_influence <= 0 || m_x.empty ())
+    {
+      return;     // every obstacle acts everywhere, no index needed
+    }
+  double minX = std::numeric_limits<double>::infinity ();
+  double minY = minX;
+  double maxX = -minX;
+  double maxY = -minX;
+  for (uint32_t i = 0; i < m_x.size (); i++)
+    {
+      double reach = m_radius[i] + m_influence;
+      minX = std::min (minX, m_x[i] - reach);
+      minY = std::min (minY, m_y[i] - reach);
+      maxX = std::max (maxX, m_x[i] + reach);
+      maxY = std::max (maxY, m_y[i] + reach);
+    }
+  // cells as large as the influence radius, at most 1024 per side
+  m_originX = minX;
+  m_originY = minY;
+  m_cellSize = std::max (m_influence, std::max (maxX - minX, maxY - minY) / 1024);
+  m_nx = static_cast<int32_t> ((maxX - minX) / m_cellSize) + 1;
+  m_ny = static_cast<int32_t> ((maxY - minY) / m_cellSize) + 1;
+  m_cells.resize (m_nx * m_ny);
+  for (uint32_t i = 0; i < m_x.size (); i++)
+    {
+      double reach = m_radius[i] + m_influence;
+      int32_t x0 = static_cast<int32_t> ((m_x[i] - reach - m_originX) / m_cellSize);
+      int32_t x1 = std::min (m_nx - 1, static_cast<int32_t> ((m_x[i] + reach - m_originX) / m_cellSize));
+      int32_t y0 = static_cast<int32_t> ((m_y[i] - reach - m_originY) / m_cellSize);
+      int32_t y1 = std::min (m_ny - 1, static_cast<int32_t> ((m_y[i] + reach - m_originY) / m_cellSize));
+      for (int32_t cy = y0; cy <= y1; cy++)
+        {
+          for (int32_t cx = x0; cx <= x1; cx++)
+            {
+              m_cells[cy * m_nx + cx].push_back (i);
+            }
+        }
+    }
+}
+
+double
+ObstacleSet::GetCharge (uint32_t i)
+{
+  if (m_chargeStamp[i] != m_stamp)
+    {
+      // the charge of a hole of radius R at distance b from the destination
+      double n = 2;
+      double dx = m_x[i] - m_dst.x;
+      double dy = m_y[i] - m_dst.y;
+      double dz = std::min (std::max (m_dst.z, m_zMin[i]), m_zMax[i]) - m_dst.z;
+      double b = std::sqrt (dx * dx + dy * dy + dz * dz);
+      m_charge[i] = (m_q * std::pow (m_radius[i], n + 1)) / (n * std::pow (b + m_radius[i], 2));
+      m_chargeStamp[i] = m_stamp;
+    }
+  return m_charge[i];
+}
+
+void
+ObstacleSet::Collect (uint32_t i, double minX, double minY, double maxX, double maxY,
+                      ChargeList &charges)
+{
+  double reach2 = std::numeric_limits<double>::infinity ();
+  if (m_influence > 0)
+    {
+      double reach = m_radius[i] + m_influence;
+      double dx = std::max (0.0, std::max (minX - m_x[i], m_x[i] - maxX));
+      double dy = std::max (0.0, std::max (minY - m_y[i], m_y[i] - maxY));
+      reach2 = reach * reach;
+      if (dx * dx + dy * dy > reach2)
+        {
+          return;
+        }
+    }
+  charges.m_x.push_back (m_x[i]);
+  charges.m_y.push_back (m_y[i]);
+  charges.m_z0.push_back (m_zMin[i]);
+  charges.m_z1.push_back (m_zMax[i]);
+  charges.m_q.push_back (GetCharge (i));
+  charges.m_reach2.push_back (reach2);
+}
+
+void
+ObstacleSet::Gather (double minX, double minY, double maxX, double maxY, Vector dst, double q,
+                     ChargeList &charges)
+{
+  charges.Clear ();
+  if (!m_indexValid)
+    {
+      BuildIndex ();
+    }
+  if (dst.x != m_dst.x || dst.y != m_dst.y || dst.z != m_dst.z || q != m_q)
+    {
+      // a new destination invalidates every charge
+      m_dst = dst;
+      m_q = q;
+      m_stamp++;
+    }
+  if (m_cells.empty ())
+    {
+      for (uint32_t i = 0; i < m_x.size (); i++)
+        {
+          Collect (i, minX, minY, maxX, maxY, charges);
+        }
+      return;
+    }
+  int32_t x0 = CellIndex (minX, m_originX, m_cellSize, m_nx);
+  int32_t x1 = CellIndex (maxX, m_originX, m_cellSize, m_nx);
+  int32_t y0 = CellIndex (minY, m_originY, m_cellSize, m_ny);
+  int32_t y1 = CellIndex (maxY, m_originY, m_cellSize, m_ny);
+  if (x1 < 0 || y1 < 0 || x0 >= m_nx || y0 >= m_ny)
+    {
+      return;     // the box lies outside the reach of every obstacle
+    }
+  x0 = std::max (x0, 0);
+  y0 = std::max (y0, 0);
+  x1 = std::min (x1, m_nx - 1);
+  y1 = std::min (y1, m_ny - 1);
+  m_query++;
+  for (int32_t cy = y0; cy <= y1; cy++)
+    {
+      for (int32_t cx = x0; cx <= x1; cx++)
+        {
+          const std::vector<uint32_t> &cell = m_cells[cy * m_nx + cx];
+          for (uint32_t k = 0; k < cell.size (); k++)
+            {
+              uint32_t i = cell[k];
+              if (m_seen[i] != m_query)
+                {
+                  m_seen[i] = m_query;
+                  Collect (i, minX, minY, maxX, maxY, charges);
+                }
+            }
+        }
+    }
+}
+
+}
+}
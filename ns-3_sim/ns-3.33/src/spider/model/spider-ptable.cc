@@ -27,10 +27,12 @@
 #include "ns3/node-container.h"
 #include "ns3/node.h"
 #include "ns3/energy-module.h"
+#include "ns3/node-directory.h"
 #include "ns3/node-container.h"
 #include "ns3/node.h"
 #include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <limits>
 
 NS_LOG_COMPONENT_DEFINE ("SpiderTable");
@@ -44,7 +46,14 @@ namespace spider {
 
 PositionTable::PositionTable() {
 	m_txErrorCallback = MakeCallback(&PositionTable::ProcessTxError, this);
-	m_entryLifeTime = Seconds(0.6); //2.25 for 5 m/s and 0.6 for 20 m/s //FIXME fazer isto parametrizavel de acordo com tempo de hello
+	m_entryLifeTime = Seconds(0.6); //2.25 for 5 m/s and 0.6 for 20 m/s, see SetLifetimeModel
+	m_range = 0;
+	m_extrapolated = Seconds(-1);
+	m_energyRefreshInterval = Seconds(0.25);
+	m_energyDrift = 0;
+	m_planarValid = false;
+	m_epoch = 0;
+	m_blacklistTimeout = Seconds(1);
 
 }
 
@@ -52,23 +61,147 @@ Time PositionTable::GetEntryUpdateTime(Ipv4Address id) {
 	if (id == Ipv4Address::GetZero()) {
 		return Time(Seconds(0));
 	}
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i = m_table.find(id);
-	return i->second.second;
+	int32_t slot = FindSlot(id);
+	if (slot < 0) {
+		return Time(Seconds(0));
+	}
+	return m_update[slot];
 }
 
 /**
  * \brief Adds entry in position table
  */
 void PositionTable::AddEntry(Ipv4Address id, Vector position) {
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i = m_table.find(
-			id);
-	if (i != m_table.end() || id==i->first) {
-		m_table.erase(id);
-		m_table.insert(
-				std::make_pair(id, std::make_pair(position, Simulator::Now())));
-	} else {
-		m_table.insert(
-				std::make_pair(id, std::make_pair(position, Simulator::Now())));
+	AddEntry(id, position, Vector(), position, Vector(), Seconds(0), 0);
+}
+
+/**
+ * \brief Adds entry of a moving neighbour in position table
+ */
+void PositionTable::AddEntry(Ipv4Address id, Vector position, Vector velocity,
+		Vector myPos, Vector myVelocity, Time holdTime, uint32_t iface) {
+	if (StoreEntry(id, position, velocity, myPos, myVelocity, holdTime,
+			iface)) {
+		m_epoch++;
+		if (!m_handleNeighborUpdate.IsNull()) {
+			m_handleNeighborUpdate(id);
+		}
+	}
+}
+
+bool PositionTable::StoreEntry(Ipv4Address id, Vector position,
+		Vector velocity, Vector myPos, Vector myVelocity, Time holdTime,
+		uint32_t iface) {
+	Purge(); // bounds m_expiry even when no packet triggers a lookup
+	if (!m_blacklist.empty()) {
+		std::map<Ipv4Address, Time>::iterator b = m_blacklist.find(id);
+		if (b != m_blacklist.end()) {
+			if (b->second > Simulator::Now()) {
+				return false; // the MAC failed to reach it, see ProcessTxError
+			}
+			m_blacklist.erase(b);
+		}
+	}
+	int32_t slot = FindSlot(id);
+	bool inserted = slot < 0;
+	if (inserted) {
+		slot = InsertSlot(id);
+	}
+	BindNode(slot, id);
+	if (m_mac[slot] == Mac48Address()) {
+		ResolveMacAddress(slot);
+	}
+	bool changed = inserted || m_x[slot] != position.x
+			|| m_y[slot] != position.y || m_z[slot] != position.z;
+	if (changed) {
+		if (m_planarValid && !inserted) {
+			PlanarDetach(slot);
+		}
+		m_x[slot] = position.x;
+		m_y[slot] = position.y;
+		m_z[slot] = position.z;
+		if (m_planarValid) {
+			PlanarAttach(slot);
+		}
+	}
+	m_baseX[slot] = position.x;
+	m_baseY[slot] = position.y;
+	m_baseZ[slot] = position.z;
+	m_vx[slot] = velocity.x;
+	m_vy[slot] = velocity.y;
+	m_vz[slot] = velocity.z;
+	m_update[slot] = Simulator::Now();
+	m_iface[slot] = iface;
+
+	Vector rel(position.x - myPos.x, position.y - myPos.y, position.z - myPos.z);
+	Vector relVel(velocity.x - myVelocity.x, velocity.y - myVelocity.y,
+			velocity.z - myVelocity.z);
+	Time lifetime = holdTime.IsStrictlyPositive() ? holdTime : m_entryLifeTime;
+	m_hold[slot] = lifetime;
+	double inRange = SecondsInRange(rel, relVel);
+	m_expire[slot] = m_update[slot] + (inRange < lifetime.GetSeconds() ?
+			Seconds(inRange) : lifetime);
+	m_expiry.push(std::make_pair(m_expire[slot], id));
+	return changed;
+}
+
+/**
+ * \brief Refreshes the entry of a neighbour from a position it sent along with data
+ */
+void PositionTable::RefreshEntry(Ipv4Address id, Vector position, Vector myPos,
+		Vector myVelocity, uint32_t iface) {
+	int32_t slot = FindSlot(id);
+	if (slot < 0) {
+		AddEntry(id, position, Vector(), myPos, myVelocity, Seconds(0), iface);
+		return;
+	}
+	// a position between hellos, as dead reckoning: the epoch is left alone
+	StoreEntry(id, position, Vector(m_vx[slot], m_vy[slot], m_vz[slot]), myPos,
+			myVelocity, m_hold[slot], iface);
+}
+
+double PositionTable::SecondsInRange(Vector rel, Vector relVel) const {
+	if (m_range <= 0) {
+		return std::numeric_limits<double>::infinity();
+	}
+	// smallest t >= 0 with |rel + relVel * t| = m_range
+	double a = relVel.x * relVel.x + relVel.y * relVel.y + relVel.z * relVel.z;
+	double b = rel.x * relVel.x + rel.y * relVel.y + rel.z * relVel.z;
+	double c = rel.x * rel.x + rel.y * rel.y + rel.z * rel.z - m_range * m_range;
+	if (c >= 0 || a == 0) {
+		// heard beyond the configured range (no estimate) or no relative motion
+		return std::numeric_limits<double>::infinity();
+	}
+	return (-b + std::sqrt(b * b - a * c)) / a;
+}
+
+void PositionTable::Extrapolate() {
+	Time now = Simulator::Now();
+	if (now == m_extrapolated) {
+		return;
+	}
+	m_extrapolated = now;
+	// positions predicted between hellos do not change the epoch
+	for (uint32_t slot = 0; slot < m_addr.size(); slot++) {
+		if (m_vx[slot] == 0 && m_vy[slot] == 0 && m_vz[slot] == 0) {
+			continue;
+		}
+		double dt = (now - m_update[slot]).GetSeconds();
+		double x = m_baseX[slot] + m_vx[slot] * dt;
+		double y = m_baseY[slot] + m_vy[slot] * dt;
+		m_z[slot] = m_baseZ[slot] + m_vz[slot] * dt;
+		if (x == m_x[slot] && y == m_y[slot]) {
+			continue;
+		}
+		// only the lune tests of a slot whose projection moved change, O(n) each
+		if (m_planarValid) {
+			PlanarDetach(slot);
+		}
+		m_x[slot] = x;
+		m_y[slot] = y;
+		if (m_planarValid) {
+			PlanarAttach(slot);
+		}
 	}
 }
 
@@ -76,8 +209,30 @@ void PositionTable::AddEntry(Ipv4Address id, Vector position) {
  * \brief Deletes entry in position table and from planarized neighbors
  */
 void PositionTable::DeleteEntry(Ipv4Address id) {
-	m_table.erase(id);
-	//m_planarized_neighbors.erase(id);
+	int32_t slot = FindSlot(id);
+	if (slot >= 0) {
+		EraseSlot(slot);
+	}
+}
+
+/**
+ * \brief Deletes the entries of the neighbours heard on an interface
+ */
+void PositionTable::DeleteInterface(uint32_t iface) {
+	// EraseSlot moves the last slot into the erased one, walk backwards
+	for (uint32_t slot = m_addr.size(); slot-- > 0;) {
+		if (m_iface[slot] == iface) {
+			EraseSlot(slot);
+		}
+	}
+}
+
+/**
+ * \brief Gets the interface a neighbour was last heard on
+ */
+uint32_t PositionTable::GetInterface(Ipv4Address id) {
+	int32_t slot = FindSlot(id);
+	return slot < 0 ? 0 : m_iface[slot];
 }
 
 /**
@@ -87,12 +242,9 @@ void PositionTable::DeleteEntry(Ipv4Address id) {
  */
 Vector PositionTable::GetPosition(Ipv4Address id) {
 
-	NodeList::Iterator listEnd = NodeList::End();
-	for (NodeList::Iterator i = NodeList::Begin(); i != listEnd; i++) {
-		Ptr<Node> node = *i;
-		if (node->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal() == id) {
-			return node->GetObject<MobilityModel>()->GetPosition();
-		}
+	Vector position;
+	if (NodeDirectory::GetPosition(id, position)) {
+		return position;
 	}
 	return PositionTable::GetInvalidPosition();
 
@@ -104,14 +256,26 @@ Vector PositionTable::GetPosition(Ipv4Address id) {
  * \return True if the node is neighbour, false otherwise
  */
 bool PositionTable::isNeighbour(Ipv4Address id) {
+	return FindSlot(id) >= 0;
+}
 
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i = m_table.find(
-			id);
-	if (i != m_table.end() || id==i->first) {
-		return true;
+/**
+ * \brief Gets the position of a neighbour as scored, extrapolated to the last scoring pass
+ */
+Vector PositionTable::GetNeighborPosition(Ipv4Address id) {
+	int32_t slot = FindSlot(id);
+	if (slot < 0) {
+		return GetInvalidPosition();
 	}
+	return Vector(m_x[slot], m_y[slot], m_z[slot]);
+}
 
-	return false;
+/**
+ * \brief Checks if the table has no neighbour left once expired entries are purged
+ */
+bool PositionTable::IsEmpty() {
+	Purge();
+	return m_addr.empty();
 }
 
 /**
@@ -119,49 +283,16 @@ bool PositionTable::isNeighbour(Ipv4Address id) {
  */
 void PositionTable::Purge() {
 
-	if (m_table.empty()) {
-		return;
-	}
-
-	std::list<Ipv4Address> toErase;
-
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i =
-			m_table.begin();
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator listEnd =
-			m_table.end();
-
-	for (; !(i == listEnd); i++) {
-
-		if (m_entryLifeTime + GetEntryUpdateTime(i->first)
-				<= Simulator::Now()) {
-			toErase.insert(toErase.begin(), i->first);
-
+	Time now = Simulator::Now();
+	while (!m_expiry.empty() && m_expiry.top().first <= now) {
+		Ipv4Address id = m_expiry.top().second;
+		m_expiry.pop();
+		int32_t slot = FindSlot(id);
+		// skip records of entries refreshed or deleted after they were pushed
+		if (slot >= 0 && m_expire[slot] <= now) {
+			EraseSlot(slot);
 		}
 	}
-	toErase.unique();
-
-	std::list<Ipv4Address>::iterator end = toErase.end();
-
-	for (std::list<Ipv4Address>::iterator it = toErase.begin(); it != end;
-			++it) {
-
-		m_table.erase(*it);
-//		m_planarized_neighbors.erase(*it);
-	}
-
-	m_ip.clear();
-	node = NodeContainer::GetGlobal();
-	int n=0;
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator j;
-	std::map<Ipv4Address, int>::iterator m;
-	for (j = m_table.begin(); !(j == m_table.end()); j++)
-	{
-		m_ip.insert(std::make_pair(j->first,n));
-		n++;
-		m=m_ip.find(j->first);
-		//std::cout<<"Here ["<<n<<"] ="<<(int)m->second<<std::endl;
-	}
-	
 
 }
 
@@ -169,26 +300,53 @@ void PositionTable::Purge() {
  * \brief clears all entries
  */
 void PositionTable::Clear() {
-	m_table.clear();
-	m_planarized_neighbors.clear();
+	m_addr.clear();
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+	m_baseX.clear();
+	m_baseY.clear();
+	m_baseZ.clear();
+	m_vx.clear();
+	m_vy.clear();
+	m_vz.clear();
+	m_update.clear();
+	m_expire.clear();
+	m_hold.clear();
+	m_iface.clear();
+	m_mac.clear();
+	m_macIndex.clear();
+	m_energy.clear();
+	m_energyRef.clear();
+	m_energyTime.clear();
+	m_node.clear();
+	m_source.clear();
+	m_index.clear();
+	m_expiry = ExpiryQueue();
+	m_witnesses.clear();
+	m_blacklist.clear();
+	m_planarValid = false;
+	m_epoch++;
 }
 
 void PositionTable::PrintNeighbors(std::ostream &os) {
 	Purge();
+	Extrapolate();
 	os << "Neighbors: ";
-	if (m_table.empty()) {
+	if (m_addr.empty()) {
 		os << "Neighbor table is empty!";
 		return;
 	}     //if table is empty (no neighbours)
 
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i;
-	for (i = m_table.begin(); !(i == m_table.end()); i++) {
-		Ipv4Address ip = i->first;
-		bool is_planarized = m_planarized_neighbors.find(ip)
-				!= m_planarized_neighbors.end();
-		Vector pos = i->second.first;
-		os << "ip=" << ip << " [" << pos.x << "," << pos.y << ","
-				<< is_planarized << "] ";
+	for (uint32_t slot = 0; slot < m_addr.size(); slot++) {
+		Ipv4Address ip = m_addr[slot];
+		bool is_planarized = m_planarValid && m_witnesses[slot] > 0;
+		os << "ip=" << ip << " [" << m_x[slot] << "," << m_y[slot] << ","
+				<< is_planarized << "]";
+		if (m_node[slot] != 0) {
+			os << " node=" << m_node[slot]->GetId();
+		}
+		os << " ";
 	}
 }
 
@@ -200,194 +358,211 @@ void PositionTable::PrintNeighbors(std::ostream &os) {
  */
 Ipv4Address PositionTable::BestNeighbor(Vector position, Vector nodePos, double lamda) {
 	Purge();
-	double b_energy=0,b_neighbor=0;
-	NodeContainer node = NodeContainer::GetGlobal();
-	Ptr<EnergySourceContainer> EnergySourceContainerOnNode = node.Get(0)->GetObject<EnergySourceContainer>();
-	Ptr<BasicEnergySource> basicSourcePtr = DynamicCast<BasicEnergySource> (EnergySourceContainerOnNode->Get(0));
-	Ptr<DeviceEnergyModel> basicRadioModelPtr = basicSourcePtr->FindDeviceEnergyModels("ns3::WifiRadioEnergyModel").Get(0);
-	//b_energy=basicRadioModelPtr->GetTotalEnergyConsumption();
-	b_energy=basicSourcePtr->GetRemainingEnergy();	
-	double b_energy_max =- std::numeric_limits<double>::infinity();// = b_energy;
-	double b_energy_min = std::numeric_limits<double>::infinity();// = b_energy;
+	Extrapolate();
 
-	double initialDistance = CalculateDistance(nodePos, position);
-	
-/*
-	Ptr<EnergySourceContainer> EnergySourceContainerOnNode1 = node.Get(39)->GetObject<EnergySourceContainer>();
-	Ptr<BasicEnergySource> basicSourcePtr1 = DynamicCast<BasicEnergySource> (EnergySourceContainerOnNode1->Get(0));
-	Ptr<DeviceEnergyModel> basicRadioModelPtr1 = basicSourcePtr1->FindDeviceEnergyModels("ns3::WifiRadioEnergyModel").Get(0);
-	std::cout << "Current energy1=" << basicSourcePtr1->GetRemainingEnergy() << " Energy Consumped1=" <<basicRadioModelPtr1->GetTotalEnergyConsumption()<< std::endl;
-	std::cout << "Current energy=" << basicSourcePtr->GetRemainingEnergy() << " Energy Consumped=" <<basicRadioModelPtr->GetTotalEnergyConsumption()<< std::endl;
-	b_energy=basicRadioModelPtr->GetTotalEnergyConsumption();
-*/
-        
-	if (m_table.empty()) {
+	if (m_addr.empty()) {
 		NS_LOG_DEBUG("BestNeighbor table is empty; Position: " << position);
 		return Ipv4Address::GetZero();
 	}     //if table is empty (no neighbours)
-        
-	Ipv4Address bestFoundID = Ipv4Address::GetZero();
-	m_nextNodes.clear();
-	//m_table.begin()->first;
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i=m_table.begin();
-	b_neighbor=CalculateDistance(i->second.first, position);
-	double maxDistance = - std::numeric_limits<double>::infinity();// =  b_neighbor;
-	double minDistance = std::numeric_limits<double>::infinity();//=  b_neighbor;
-	double minObj = std::numeric_limits<double>::infinity();// = lamda * b_neighbor + (1-lamda) * b_energy;
-	for (i = m_table.begin(); !(i == m_table.end()); i++) {
-		b_neighbor=CalculateDistance(i->second.first, position);	
-		if (initialDistance > b_neighbor)
-		{
-			m_nextNodes.insert(
-				std::make_pair(i->first, std::make_pair(i->second.first, i->second.second)));
-			if(b_neighbor>maxDistance)
-			{
-				maxDistance = b_neighbor;
-			}
-			if(b_neighbor<minDistance)
-			{
-				minDistance = b_neighbor;
-			}
-			// Compute Energy Remaining
-			Ptr<EnergySourceContainer> EnergySourceContainerOnNode = node.Get((int)m_ip.find(i->first)->second)->GetObject<EnergySourceContainer>();
-			Ptr<BasicEnergySource> basicSourcePtr = DynamicCast<BasicEnergySource> (EnergySourceContainerOnNode->Get(0));
-			Ptr<DeviceEnergyModel> basicRadioModelPtr = basicSourcePtr->FindDeviceEnergyModels("ns3::WifiRadioEnergyModel").Get(0);
-			//std::cout << "At node =" << i->first << " remaining energy=" << basicSourcePtr->GetRemainingEnergy() << " energy consumption=" <<basicRadioModelPtr->GetTotalEnergyConsumption()<< std::endl;
-			b_energy=basicSourcePtr->GetRemainingEnergy();				
-			//b_energy=basicRadioModelPtr->GetTotalEnergyConsumption();
-			if(b_energy>b_energy_max)
-			{
-				b_energy_max = b_energy;
-			}
-			if(b_energy<b_energy_min)
-			{
-				b_energy_min = b_energy;
-			}
-		}
+
+	// progress filter, normalization ranges and objective run as vector passes
+	// over the position columns; see spider-kernels.h
+	RefreshEnergy();
+	double initialDistance = CalculateDistance(nodePos, position);
+	m_candMetric.resize(m_addr.size());
+	spider::ScoreRanges ranges;
+	spider::DistanceRanges(&m_x[0], &m_y[0], &m_z[0], &m_energy[0], m_addr.size(),
+			position.x, position.y, position.z, initialDistance, &m_candMetric[0], ranges);
+
+	return SelectCandidate(lamda, initialDistance, ranges);
+}
+
+void PositionTable::BestNeighbors(Vector position, Vector nodePos,
+		double lamda, uint32_t k, double slack,
+		std::vector<WeightedNeighbor> &hops) {
+	hops.clear();
+	Purge();
+	Extrapolate();
+
+	if (m_addr.empty()) {
+		NS_LOG_DEBUG("BestNeighbors table is empty; Position: " << position);
+		return;
+	}     //if table is empty (no neighbours)
+
+	// the passes of BestNeighbor, or of GreedyNeighbor when energy does not count
+	double initialDistance = CalculateDistance(nodePos, position);
+	if (lamda < 1) {
+		RefreshEnergy();
 	}
-	//std::cout<<"At time [" << Simulator::Now().GetSeconds ()<<"]"<<std::endl;
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator j;
-	for (j = m_nextNodes.begin(); !(j == m_nextNodes.end()); j++) {
-		b_neighbor=CalculateDistance(j->second.first, position);
-		// Compute Energy Remaining
-		Ptr<EnergySourceContainer> EnergySourceContainerOnNode = node.Get((int)m_ip.find(j->first)->second)->GetObject<EnergySourceContainer>();
-		Ptr<BasicEnergySource> basicSourcePtr = DynamicCast<BasicEnergySource> (EnergySourceContainerOnNode->Get(0));
-		Ptr<DeviceEnergyModel> basicRadioModelPtr = basicSourcePtr->FindDeviceEnergyModels("ns3::WifiRadioEnergyModel").Get(0);
-		b_energy=basicSourcePtr->GetRemainingEnergy();	
-		//b_energy=basicRadioModelPtr->GetTotalEnergyConsumption();
-		// normalization
-		b_neighbor = (b_neighbor-minDistance)/(maxDistance-minDistance);
-		b_energy = (b_energy-b_energy_min)/(b_energy_max-b_energy_min);
-		double Obj = lamda * b_neighbor + (1-lamda) * -b_energy;
-		//std::cout<<"At node ["<<m_ip.find(j->first)->second<<"]"<< " objective function = " <<Obj<<std::endl;
-		if (minObj > Obj) {
-			bestFoundID = j->first;
-			minObj = Obj;
-		}
+	m_candMetric.resize(m_addr.size());
+	spider::ScoreRanges ranges;
+	spider::DistanceRanges(&m_x[0], &m_y[0], &m_z[0], &m_energy[0], m_addr.size(),
+			position.x, position.y, position.z, initialDistance, &m_candMetric[0], ranges);
+	if (lamda >= 1) {
+		ranges.maxEnergy = ranges.minEnergy;
 	}
-	return bestFoundID;	
+
+	SelectCandidates(lamda, initialDistance, ranges, k, slack, hops);
+}
+
+Ipv4Address PositionTable::GreedyNeighbor(Vector position, Vector nodePos) {
+	Purge();
+	Extrapolate();
+
+	if (m_addr.empty()) {
+		NS_LOG_DEBUG("GreedyNeighbor table is empty; Position: " << position);
+		return Ipv4Address::GetZero();
+	}     //if table is empty (no neighbours)
+
+	// the distance pass alone; energy is left out of the objective
+	double initialDistance = CalculateDistance(nodePos, position);
+	m_candMetric.resize(m_addr.size());
+	spider::ScoreRanges ranges;
+	spider::DistanceRanges(&m_x[0], &m_y[0], &m_z[0], &m_energy[0], m_addr.size(),
+			position.x, position.y, position.z, initialDistance, &m_candMetric[0], ranges);
+	ranges.maxEnergy = ranges.minEnergy;
+
+	return SelectCandidate(1, initialDistance, ranges);
 }
 
 /**
  * \brief Gets next hop according to Electrostatics based Greedy Forwarding
  * \param position the position of the destination node
  * \param nodePos the position of the node that has the packet
+ * \param obstacles the obstacles repelling the packet
  * \return Ipv4Address of the next hop, Ipv4Address::GetZero () if no nighbour was found in Repulsion mode
  */
 Ipv4Address PositionTable::ElectrostaticBestNeighbor(Vector position, Vector nodePos,
-		double locationX, double locationY, double radius, double lamda) {
+		ObstacleSet &obstacles, double lamda) {
 	Purge();
-	double b_energy=0;
-	NodeContainer node = NodeContainer::GetGlobal();
-	Ptr<EnergySourceContainer> EnergySourceContainerOnNode = node.Get(0)->GetObject<EnergySourceContainer>();
-	Ptr<BasicEnergySource> basicSourcePtr = DynamicCast<BasicEnergySource> (EnergySourceContainerOnNode->Get(0));
-	Ptr<DeviceEnergyModel> basicRadioModelPtr = basicSourcePtr->FindDeviceEnergyModels("ns3::WifiRadioEnergyModel").Get(0);
-	b_energy=basicSourcePtr->GetRemainingEnergy();	
-	//b_energy=basicRadioModelPtr->GetTotalEnergyConsumption();
-	double b_energy_max =- std::numeric_limits<double>::infinity();//= b_energy;
-	double b_energy_min = std::numeric_limits<double>::infinity();//= b_energy;
-	double q = 1;
-	double n = 2;
-	Vector holeC(locationX,locationY,0);
-	double holeR = radius;
-
-	//calculate hole charge ql
-	double b = CalculateDistance(holeC, position);
-	double ql = (q * std::pow(holeR, n + 1)) / (n * std::pow(b + holeR, 2));
+	Extrapolate();
 
-	double initPotential = -q / CalculateDistance(nodePos, position)
-			+ ql / (std::pow(CalculateDistance(nodePos, holeC), n));
-
-
-	if (m_table.empty()) {
+	if (m_addr.empty()) {
 		NS_LOG_DEBUG("BestNeighbor table is empty; Position: " << position);
 		return Ipv4Address::GetZero();
 	}     //if table is empty (no neighbours)
 
+	// only the obstacles reaching this node or one of its neighbours take part
+	double minX = nodePos.x, maxX = nodePos.x;
+	double minY = nodePos.y, maxY = nodePos.y;
+	for (uint32_t slot = 0; slot < m_addr.size(); slot++) {
+		minX = std::min(minX, m_x[slot]);
+		maxX = std::max(maxX, m_x[slot]);
+		minY = std::min(minY, m_y[slot]);
+		maxY = std::max(maxY, m_y[slot]);
+	}
+	double q = 1;
+	obstacles.Gather(minX, minY, maxX, maxY, position, q, m_charges);
+	spider::PointCharges charges = m_charges.Get();
+
+	double initPotential = spider::Potential(nodePos.x, nodePos.y, nodePos.z,
+			position.x, position.y, position.z, q, charges);
+
+	// keep the neighbours with a lower potential and score them
+	RefreshEnergy();
+	m_candMetric.resize(m_addr.size());
+	spider::ScoreRanges ranges;
+	spider::PotentialRanges(&m_x[0], &m_y[0], &m_z[0], &m_energy[0], m_addr.size(),
+			position.x, position.y, position.z, q, charges,
+			initPotential, &m_candMetric[0], ranges);
+
+	return SelectCandidate(lamda, initPotential, ranges);
+}
+
+Ipv4Address PositionTable::SelectCandidate(double lamda, double bound,
+		const spider::ScoreRanges &ranges) {
+	double minObj = spider::LambdaObjective(&m_candMetric[0], &m_energy[0],
+			m_addr.size(), bound, lamda, ranges);
 	Ipv4Address bestFoundID = Ipv4Address::GetZero();
-	m_nextNodes.clear();
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i=m_table.begin();
-	double tmpPotential = -q / CalculateDistance(i->second.first, position)
-				+ ql / (std::pow(CalculateDistance(i->second.first, holeC), n));
-	double maxPotential = - std::numeric_limits<double>::infinity();// = tmpPotential;
-	double minPotential = std::numeric_limits<double>::infinity();// = tmpPotential;
-	double minObj = std::numeric_limits<double>::infinity();// = lamda * tmpPotential + (1-lamda) * b_energy;
-
-	for (i = m_table.begin(); !(i == m_table.end()); i++) {
-		tmpPotential = -q / CalculateDistance(i->second.first, position)
-				+ ql / (std::pow(CalculateDistance(i->second.first, holeC), n));	
-		if (initPotential > tmpPotential)
-		{
-			m_nextNodes.insert(
-				std::make_pair(i->first, std::make_pair(i->second.first, i->second.second)));
-			if(tmpPotential>maxPotential)
-			{
-				maxPotential = tmpPotential;
-			}
-			if(tmpPotential<minPotential)
-			{
-				minPotential = tmpPotential;
-			}
-			// Compute Energy Remaining
-		Ptr<EnergySourceContainer> EnergySourceContainerOnNode = node.Get((int)m_ip.find(i->first)->second)->GetObject<EnergySourceContainer>();
-		Ptr<BasicEnergySource> basicSourcePtr = DynamicCast<BasicEnergySource> (EnergySourceContainerOnNode->Get(0));
-		Ptr<DeviceEnergyModel> basicRadioModelPtr = basicSourcePtr->FindDeviceEnergyModels("ns3::WifiRadioEnergyModel").Get(0);
-		b_energy=basicSourcePtr->GetRemainingEnergy();	
-		//b_energy=basicRadioModelPtr->GetTotalEnergyConsumption();
-			if(b_energy>b_energy_max)
-			{
-				b_energy_max = b_energy;
-			}
-			if(b_energy<b_energy_min)
-			{
-				b_energy_min = b_energy;
-			}
+	if (!(minObj < std::numeric_limits<double>::infinity())) {
+		return bestFoundID;
+	}
+	// equal objectives go to the lowest address, independent of slot order
+	for (uint32_t slot = 0; slot < m_addr.size(); slot++) {
+		if (m_candMetric[slot] == minObj
+				&& (bestFoundID == Ipv4Address::GetZero() || m_addr[slot] < bestFoundID)) {
+			bestFoundID = m_addr[slot];
 		}
 	}
-	//std::cout<<"At time [" << Simulator::Now().GetSeconds ()<<"]"<<std::endl;
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator j;
-	for (j = m_nextNodes.begin(); !(j == m_nextNodes.end()); j++) {
-		tmpPotential = -q / CalculateDistance(j->second.first, position)
-				+ ql / (std::pow(CalculateDistance(j->second.first, holeC), n));
-		// Compute Energy Remaining
-		Ptr<EnergySourceContainer> EnergySourceContainerOnNode = node.Get((int)m_ip.find(j->first)->second)->GetObject<EnergySourceContainer>();
-		Ptr<BasicEnergySource> basicSourcePtr = DynamicCast<BasicEnergySource> (EnergySourceContainerOnNode->Get(0));
-		Ptr<DeviceEnergyModel> basicRadioModelPtr = basicSourcePtr->FindDeviceEnergyModels("ns3::WifiRadioEnergyModel").Get(0);
-		b_energy=basicSourcePtr->GetRemainingEnergy();	
-		//b_energy=basicRadioModelPtr->GetTotalEnergyConsumption();
-		// normalization
-		tmpPotential = (tmpPotential-minPotential)/(maxPotential-minPotential);
-		b_energy = (b_energy-b_energy_min)/(b_energy_max-b_energy_min);
-		double Obj = lamda * tmpPotential + (1-lamda) * -b_energy;
-		//std::cout<<"At node ["<<m_ip.find(j->first)->second<<"]"<< " objective function = " <<Obj<<std::endl;
-		if (minObj > Obj) {
-			
-			bestFoundID = j->first;
-			minObj = Obj;
+	return bestFoundID;
+}
+
+void PositionTable::SelectCandidates(double lamda, double bound,
+		const spider::ScoreRanges &ranges, uint32_t k, double slack,
+		std::vector<WeightedNeighbor> &hops) {
+	double minObj = spider::LambdaObjective(&m_candMetric[0], &m_energy[0],
+			m_addr.size(), bound, lamda, ranges);
+	if (!(minObj < std::numeric_limits<double>::infinity())) {
+		return;
+	}
+	// (objective, address): equal objectives go to the lowest address, as in SelectCandidate
+	std::vector<std::pair<double, Ipv4Address> > ranked;
+	for (uint32_t slot = 0; slot < m_addr.size(); slot++) {
+		if (m_candMetric[slot] <= minObj + slack) {
+			ranked.push_back(std::make_pair(m_candMetric[slot], m_addr[slot]));
 		}
+	}
+	uint32_t n = std::min<uint32_t>(k, ranked.size());
+	std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end());
+	for (uint32_t i = 0; i < n; i++) {
+		hops.push_back(WeightedNeighbor(ranked[i].second,
+				1 - (ranked[i].first - minObj)));
+	}
+}
+
+uint32_t PositionTable::Refresh() {
+	Purge();
+	if (m_energyDrift > 0) {
+		RefreshEnergy();
+	}
+	return m_epoch;
+}
+
+void PositionTable::RefreshEnergy() {
+	for (uint32_t slot = 0; slot < m_addr.size(); slot++) {
+		GetNeighborEnergy(slot);
+	}
+}
+
+double PositionTable::GetNeighborEnergy(uint32_t slot) {
+	if (m_source[slot] == 0) {
+		m_energy[slot] = 0;
+		return 0;
+	}
+	// GetRemainingEnergy forces an energy-source update, so reuse recent readings
+	Time now = Simulator::Now();
+	if (m_energyTime[slot].IsZero()
+			|| now - m_energyTime[slot] >= m_energyRefreshInterval) {
+		m_energy[slot] = m_source[slot]->GetRemainingEnergy();
+		if (m_energyTime[slot].IsZero()) {
+			m_energyRef[slot] = m_energy[slot];
+		} else if (m_energyDrift > 0
+				&& std::fabs(m_energy[slot] - m_energyRef[slot])
+						> m_energyDrift * m_energyRef[slot]) {
+			m_energyRef[slot] = m_energy[slot];
+			m_epoch++;
+		}
+		m_energyTime[slot] = now;
+	}
+	return m_energy[slot];
+}
 
+void PositionTable::BindNode(uint32_t slot, Ipv4Address id) {
+	// one directory lookup; only a changed owner re-resolves the energy source
+	Ptr<Node> owner = NodeDirectory::GetNode(id);
+	if (owner == m_node[slot] && owner != 0) {
+		return;
+	}
+	m_node[slot] = owner;
+	m_source[slot] = 0;
+	m_energyTime[slot] = Time(0);
+	if (owner == 0) {
+		return;
+	}
+	Ptr<EnergySourceContainer> sources = owner->GetObject<EnergySourceContainer>();
+	if (sources != 0 && sources->GetN() > 0) {
+		m_source[slot] = DynamicCast<BasicEnergySource> (sources->Get(0));
 	}
-	return bestFoundID;	
 }
 
 /**
@@ -398,32 +573,52 @@ Ipv4Address PositionTable::ElectrostaticBestNeighbor(Vector position, Vector nod
  */
 Ipv4Address PositionTable::BestAngle(Vector previousHop, Vector nodePos) {
 	Purge();
+	Extrapolate();
 	PlanarizeNeighbors(nodePos);
 
-	if (m_table.empty()) {
+	if (m_addr.empty()) {
 		NS_LOG_DEBUG("BestNeighbor table is empty; Position: " << nodePos);
 		return Ipv4Address::GetZero();
 	}     //if table is empty (no neighbours)
 
-	double tmpAngle;
+	// Pseudo-angles order neighbours exactly like GetAngle without calling it per slot
+	uint32_t n = m_addr.size();
+	m_candMetric.resize(n);
+	Vector ref = previousHop;
+	if (ref.x == nodePos.x && ref.y == nodePos.y) {
+		ref.x += 1; // previous hop straight above or below, no reference edge in the projection
+	}
+	spider::RhrPseudoAngles(&m_x[0], &m_y[0], n, nodePos.x, nodePos.y,
+			ref.x, ref.y, &m_candMetric[0]);
+
 	Ipv4Address bestFoundID = Ipv4Address::GetZero();
-	double bestFoundAngle = 360;
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i;
-
-	for (i = m_table.begin(); !(i == m_table.end()); i++) {
-		if (m_planarized_neighbors.find(i->first)
-				== m_planarized_neighbors.end()) {
-			tmpAngle = GetAngle(nodePos, previousHop, i->second.first);
-			if (bestFoundAngle > tmpAngle && tmpAngle != 0) {
-				bestFoundID = i->first;
-				bestFoundAngle = tmpAngle;
+	Ipv4Address backID = Ipv4Address::GetZero();
+	double bestFoundAngle = 4;
+
+	for (uint32_t slot = 0; slot < n; slot++) {
+		if (m_witnesses[slot] != 0) {
+			continue;
+		}
+		if (m_x[slot] == nodePos.x && m_y[slot] == nodePos.y) {
+			continue; // straight above or below: no angle, and not the way back
+		}
+		double tmpAngle = m_candMetric[slot];
+		if (tmpAngle == 0) {
+			// along the reference edge: back where the packet came from
+			if (backID == Ipv4Address::GetZero() || m_addr[slot] < backID) {
+				backID = m_addr[slot];
 			}
+		} else if (bestFoundAngle > tmpAngle
+				|| (bestFoundAngle == tmpAngle && m_addr[slot] < bestFoundID)) {
+			bestFoundID = m_addr[slot];
+			bestFoundAngle = tmpAngle;
 		}
 	}
 
 	if (bestFoundID == Ipv4Address::GetZero())
 	{
-		bestFoundID = m_table.begin()->first;
+		// dead end of the face, turn back along the edge it came from
+		bestFoundID = backID;
 	}
 
 	return bestFoundID;
@@ -433,40 +628,88 @@ Ipv4Address PositionTable::BestAngle(Vector previousHop, Vector nodePos) {
 double PositionTable::GetAngle(Vector centrePos, Vector refPos, Vector node) {
 	double const PI = 4 * atan(1);
 
-	std::complex<double> A = std::complex<double>(centrePos.x, centrePos.y);
-	std::complex<double> B = std::complex<double>(node.x, node.y);
-	std::complex<double> C = std::complex<double>(refPos.x, refPos.y); //Change B with C if you want angles clockwise
+	// angle of AC relative to AB, i.e. arg(AC * conj(AB))
+	double bx = node.x - centrePos.x;
+	double by = node.y - centrePos.y;
+	double cx = refPos.x - centrePos.x; //Swap B and C if you want angles clockwise
+	double cy = refPos.y - centrePos.y;
 
-	std::complex<double> AB; //reference edge
-	std::complex<double> AC;
-	std::complex<double> tmp;
-	std::complex<double> tmpCplx;
+	double angle = atan2(bx * cy - by * cx, bx * cx + by * cy) * (180 / PI);
+	if (angle < 0)
+		angle += 360;
 
-	std::complex<double> Angle;
+	return angle;
+}
 
-	AB = B - A;
-	AB = (real(AB) / norm(AB))
-			+ (std::complex<double>(0.0, 1.0) * (imag(AB) / norm(AB)));
+/**
+ * \ProcessTxError
+ */
+void PositionTable::ProcessTxError(WifiMacHeader const & hdr) {
+	Mac48Address addr = hdr.GetAddr1();
+	if (addr.IsGroup()) {
+		return;
+	}
+	Ipv4Address id = LookupNeighbor(addr);
+	if (FindSlot(id) < 0) {
+		return; // unknown, or already blacklisted by an earlier frame
+	}
+	// the MAC spent its retries on it: a failed node or one out of range
+	DeleteEntry(id);
+	if (m_blacklistTimeout > Seconds(0)) {
+		m_blacklist[id] = Simulator::Now() + m_blacklistTimeout;
+	}
+	if (!m_handleLinkFailure.IsNull()) {
+		m_handleLinkFailure(id);
+	}
+}
 
-	AC = C - A;
-	AC = (real(AC) / norm(AC))
-			+ (std::complex<double>(0.0, 1.0) * (imag(AC) / norm(AC)));
+void PositionTable::AddArpCache(Ptr<ArpCache> a) {
+	m_arp.push_back(a);
+}
 
-	tmp = log(AC / AB);
-	tmpCplx = std::complex<double>(0.0, -1.0);
-	Angle = tmp * tmpCplx;
-	Angle *= (180 / PI);
-	if (real(Angle) < 0)
-		Angle = 360 + real(Angle);
+void PositionTable::DelArpCache(Ptr<ArpCache> a) {
+	m_arp.erase(std::remove(m_arp.begin(), m_arp.end(), a), m_arp.end());
+}
 
-	return real(Angle);
+Ipv4Address PositionTable::LookupNeighbor(Mac48Address hwaddr) {
+	std::map<Mac48Address, Ipv4Address>::iterator i = m_macIndex.find(hwaddr);
+	if (i != m_macIndex.end()) {
+		if (FindSlot(i->second) >= 0
+				|| m_blacklist.find(i->second) != m_blacklist.end()) {
+			return i->second;
+		}
+		m_macIndex.erase(i); // expired since it was resolved
+	}
+	// ARP may have resolved neighbours after their last hello
+	for (uint32_t slot = 0; slot < m_addr.size(); ++slot) {
+		if (m_mac[slot] == Mac48Address() && ResolveMacAddress(slot)
+				&& m_mac[slot] == hwaddr) {
+			return m_addr[slot];
+		}
+	}
+	return Ipv4Address::GetZero();
+}
 
+bool PositionTable::ResolveMacAddress(uint32_t slot) {
+	m_mac[slot] = LookupMacAddress(m_addr[slot]);
+	if (m_mac[slot] == Mac48Address()) {
+		return false;
+	}
+	m_macIndex[m_mac[slot]] = m_addr[slot];
+	return true;
 }
 
-/**
- * \ProcessTxError
- */
-void PositionTable::ProcessTxError(WifiMacHeader const & hdr) {
+Mac48Address PositionTable::LookupMacAddress(Ipv4Address id) {
+	Mac48Address hwaddr;
+	for (std::vector<Ptr<ArpCache> >::const_iterator i = m_arp.begin();
+			i != m_arp.end(); ++i) {
+		ArpCache::Entry * entry = (*i)->Lookup(id);
+		if (entry != 0 && entry->IsAlive() && !entry->IsExpired()) {
+			hwaddr = Mac48Address::ConvertFrom(entry->GetMacAddress());
+			break;
+		}
+	}
+	return hwaddr;
 }
 
 //FIXME ainda preciso disto agr que o LS ja n está aqui???????
@@ -496,24 +739,203 @@ void PositionTable::PlanarizeNeighbors(Vector nodePos) {
 	 break;
 	 }*/
 
-	m_planarized_neighbors.clear();
-	Vector u = nodePos;
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator i;
-	std::map<Ipv4Address, std::pair<Vector, Time> >::iterator j;
-	for (i = m_table.begin(); !(i == m_table.end()); i++) {
-		Vector v = i->second.first;
-		for (j = m_table.begin(); !(j == m_table.end()); j++) {
-			Vector w = j->second.first;
-			if ((i->first)==(j->first)) {
-				continue;
-			} else if (CalculateDistance(u, v)
-					> std::max(CalculateDistance(u, w),
-							CalculateDistance(v, w))) {
-				m_planarized_neighbors.insert(i->first);
-				break;
+	if (m_planarValid && m_planarOrigin.x == nodePos.x
+			&& m_planarOrigin.y == nodePos.y) {
+		return;
+	}
+
+	m_planarOrigin = nodePos;
+	for (uint32_t i = 0; i < m_addr.size(); i++) {
+		m_witnesses[i] = 0;
+		for (uint32_t j = 0; j < m_addr.size(); j++) {
+			if (i != j && InLune(i, j)) {
+				m_witnesses[i]++;
 			}
 		}
 	}
+	m_planarValid = true;
+}
+
+static inline double SquaredDistance(double ax, double ay, double bx,
+		double by) {
+	return (ax - bx) * (ax - bx) + (ay - by) * (ay - by);
+}
+
+bool PositionTable::InLune(uint32_t v, uint32_t w) const {
+	// d(u,v) > max(d(u,w), d(v,w)), compared on squared distances of the projections
+	const Vector &u = m_planarOrigin;
+	double uv = SquaredDistance(u.x, u.y, m_x[v], m_y[v]);
+	double uw = SquaredDistance(u.x, u.y, m_x[w], m_y[w]);
+	double vw = SquaredDistance(m_x[v], m_y[v], m_x[w], m_y[w]);
+	return uv > std::max(uw, vw);
+}
+
+void PositionTable::PlanarAttach(uint32_t slot) {
+	m_witnesses[slot] = 0;
+	for (uint32_t other = 0; other < m_addr.size(); other++) {
+		if (other == slot) {
+			continue;
+		}
+		if (InLune(slot, other)) {
+			m_witnesses[slot]++;
+		}
+		if (InLune(other, slot)) {
+			m_witnesses[other]++;
+		}
+	}
+}
+
+void PositionTable::PlanarDetach(uint32_t slot) {
+	for (uint32_t other = 0; other < m_addr.size(); other++) {
+		if (other != slot && InLune(other, slot)) {
+			m_witnesses[other]--;
+		}
+	}
+}
+
+int32_t PositionTable::FindSlot(Ipv4Address id) const {
+	int32_t bucket = FindBucket(id);
+	return bucket < 0 ? -1 : m_index[bucket];
+}
+
+int32_t PositionTable::FindBucket(Ipv4Address id) const {
+	if (m_index.empty()) {
+		return -1;
+	}
+	uint32_t mask = m_index.size() - 1;
+	for (uint32_t b = HomeBucket(id);; b = (b + 1) & mask) {
+		if (m_index[b] < 0) {
+			return -1;
+		}
+		if (m_addr[m_index[b]] == id) {
+			return b;
+		}
+	}
+}
+
+uint32_t PositionTable::HomeBucket(Ipv4Address id) const {
+	// multiplicative (Fibonacci) hashing, m_index size is a power of two
+	return (id.Get() * 2654435761u) & (m_index.size() - 1);
+}
+
+uint32_t PositionTable::InsertSlot(Ipv4Address id) {
+	uint32_t slot = m_addr.size();
+	m_addr.push_back(id);
+	m_x.push_back(0);
+	m_y.push_back(0);
+	m_z.push_back(0);
+	m_baseX.push_back(0);
+	m_baseY.push_back(0);
+	m_baseZ.push_back(0);
+	m_vx.push_back(0);
+	m_vy.push_back(0);
+	m_vz.push_back(0);
+	m_update.push_back(Time(0));
+	m_expire.push_back(Time(0));
+	m_hold.push_back(Time(0));
+	m_iface.push_back(0);
+	m_mac.push_back(Mac48Address());
+	m_energy.push_back(0);
+	m_energyRef.push_back(0);
+	m_witnesses.push_back(0);
+	m_energyTime.push_back(Time(0));
+	m_node.push_back(0);
+	m_source.push_back(0);
+	// keep the load factor at or below 1/2
+	if (2 * m_addr.size() > m_index.size()) {
+		IndexRehash(std::max<uint32_t>(16, 2 * m_index.size()));
+		return slot;
+	}
+	uint32_t mask = m_index.size() - 1;
+	uint32_t b = HomeBucket(id);
+	while (m_index[b] >= 0) {
+		b = (b + 1) & mask;
+	}
+	m_index[b] = slot;
+	return slot;
+}
+
+void PositionTable::EraseSlot(uint32_t slot) {
+	if (m_planarValid) {
+		PlanarDetach(slot);
+	}
+	m_epoch++;
+	IndexErase(m_addr[slot]);
+	uint32_t last = m_addr.size() - 1;
+	if (slot != last) {
+		m_index[FindBucket(m_addr[last])] = slot;
+		m_addr[slot] = m_addr[last];
+		m_x[slot] = m_x[last];
+		m_y[slot] = m_y[last];
+		m_z[slot] = m_z[last];
+		m_baseX[slot] = m_baseX[last];
+		m_baseY[slot] = m_baseY[last];
+		m_baseZ[slot] = m_baseZ[last];
+		m_vx[slot] = m_vx[last];
+		m_vy[slot] = m_vy[last];
+		m_vz[slot] = m_vz[last];
+		m_update[slot] = m_update[last];
+		m_expire[slot] = m_expire[last];
+		m_hold[slot] = m_hold[last];
+		m_iface[slot] = m_iface[last];
+		m_mac[slot] = m_mac[last];
+		m_energy[slot] = m_energy[last];
+		m_energyRef[slot] = m_energyRef[last];
+		m_witnesses[slot] = m_witnesses[last];
+		m_energyTime[slot] = m_energyTime[last];
+		m_node[slot] = m_node[last];
+		m_source[slot] = m_source[last];
+	}
+	m_addr.pop_back();
+	m_x.pop_back();
+	m_y.pop_back();
+	m_z.pop_back();
+	m_baseX.pop_back();
+	m_baseY.pop_back();
+	m_baseZ.pop_back();
+	m_vx.pop_back();
+	m_vy.pop_back();
+	m_vz.pop_back();
+	m_update.pop_back();
+	m_expire.pop_back();
+	m_hold.pop_back();
+	m_iface.pop_back();
+	m_mac.pop_back();
+	m_energy.pop_back();
+	m_energyRef.pop_back();
+	m_witnesses.pop_back();
+	m_energyTime.pop_back();
+	m_node.pop_back();
+	m_source.pop_back();
+}
+
+void PositionTable::IndexErase(Ipv4Address id) {
+	int32_t hole = FindBucket(id);
+	if (hole < 0) {
+		return;
+	}
+	// shift back the entries of the probe run that would become unreachable
+	uint32_t mask = m_index.size() - 1;
+	for (uint32_t b = (hole + 1) & mask; m_index[b] >= 0; b = (b + 1) & mask) {
+		uint32_t home = HomeBucket(m_addr[m_index[b]]);
+		if (((b - home) & mask) >= ((b - hole) & mask)) {
+			m_index[hole] = m_index[b];
+			hole = b;
+		}
+	}
+	m_index[hole] = -1;
+}
+
+void PositionTable::IndexRehash(uint32_t buckets) {
+	m_index.assign(buckets, -1);
+	uint32_t mask = buckets - 1;
+	for (uint32_t slot = 0; slot < m_addr.size(); slot++) {
+		uint32_t b = HomeBucket(m_addr[slot]);
+		while (m_index[b] >= 0) {
+			b = (b + 1) & mask;
+		}
+		m_index[b] = slot;
+	}
 }
 
 }   // spider
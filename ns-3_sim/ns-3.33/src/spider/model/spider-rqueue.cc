@@ -23,6 +23,7 @@
 /*  Revision:  1.0         6/19/2017                                        */
 /****************************************************************************/
 #include "spider-rqueue.h"
+#include "spider-packet.h"
 #include <algorithm>
 #include <functional>
 #include "ns3/ipv4-route.h"
@@ -33,34 +34,76 @@ NS_LOG_COMPONENT_DEFINE ("SpiderRequestQueue");
 
 namespace ns3 {
 namespace spider {
+const uint32_t RequestQueue::NO_NODE;
+
 uint32_t
 RequestQueue::GetSize ()
 {
   Purge ();
-  return m_queue.size ();
+  return m_size;
 }
 
 bool
 RequestQueue::Enqueue (QueueEntry & entry)
 {
   Purge ();
-  for (std::vector<QueueEntry>::const_iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  Ipv4Address dst = entry.GetIpv4Header ().GetDestination ();
+  uint64_t uid = entry.GetPacket ()->GetUid ();
+  if (!m_uids.insert (std::make_pair (uid, dst)).second)
     {
-      if ((i->GetPacket ()->GetUid () == entry.GetPacket ()->GetUid ())
-          && (i->GetIpv4Header ().GetDestination ()
-              == entry.GetIpv4Header ().GetDestination ()))
+      return false;
+    }
+  entry.SetExpireTime (m_queueTimeout);
+  uint32_t oldest;
+  if (m_size >= m_maxLen && PopOldest (oldest))
+    {
+      Ipv4Address oldestDst = m_nodes[oldest].dst;
+      QueueEntry aged = Kill (oldest);
+      FifoMap::iterator i = m_fifos.find (oldestDst);
+      if (i->second.size == 0)
         {
-          return false;
+          EraseFifo (i);
         }
+      Drop (aged, "Drop the most aged packet");     // Drop the most aged packet
     }
-  entry.SetExpireTime (m_queueTimeout);
-  if (m_queue.size () == m_maxLen)
+
+  uint32_t node;
+  if (m_freeNodes.empty ())
     {
-      Drop (m_queue.front (), "Drop the most aged packet");     // Drop the most aged packet
-      m_queue.erase (m_queue.begin ());
+      node = m_nodes.size ();
+      m_nodes.push_back (Node ());
+      m_nodes[node].generation = 0;
     }
-  m_queue.push_back (entry);
+  else
+    {
+      node = m_freeNodes.back ();
+      m_freeNodes.pop_back ();
+    }
+  Node &n = m_nodes[node];
+  n.entry = entry;
+  n.dst = dst;
+  n.uid = uid;
+  n.next = NO_NODE;
+  n.live = true;
+
+  FifoMap::iterator i = m_fifos.find (dst);
+  if (i == m_fifos.end ())
+    {
+      Fifo fifo;
+      fifo.head = node;
+      fifo.tail = node;
+      fifo.size = 1;
+      m_fifos.insert (std::make_pair (dst, fifo));
+    }
+  else
+    {
+      m_nodes[i->second.tail].next = node;
+      i->second.tail = node;
+      i->second.size++;
+    }
+  m_size++;
+  m_expiry.push (std::make_pair (Simulator::Now () + entry.GetExpireTime (),
+                                 std::make_pair (node, n.generation)));
   return true;
 }
 
@@ -69,72 +112,148 @@ RequestQueue::DropPacketWithDst (Ipv4Address dst)
 {
   NS_LOG_FUNCTION (this << dst);
   Purge ();
-  //const Ipv4Address addr = dst;
-  for (std::vector<QueueEntry>::iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  FifoMap::iterator i = m_fifos.find (dst);
+  if (i == m_fifos.end ())
     {
-      if (IsEqual (*i, dst))
+      return;
+    }
+  std::vector<QueueEntry> dropped;
+  dropped.reserve (i->second.size);
+  for (uint32_t node = i->second.head; node != NO_NODE; node = m_nodes[node].next)
+    {
+      if (m_nodes[node].live)
         {
-          Drop (*i, "DropPacketWithDst ");
+          dropped.push_back (Kill (node));
         }
     }
-  m_queue.erase (std::remove_if (m_queue.begin (), m_queue.end (),
-                                 std::bind2nd (std::ptr_fun (RequestQueue::IsEqual), dst)), m_queue.end ());
+  EraseFifo (i);
+  for (std::vector<QueueEntry>::const_iterator e = dropped.begin (); e != dropped.end (); ++e)
+    {
+      Drop (*e, "DropPacketWithDst ");
+    }
 }
 
 bool
 RequestQueue::Dequeue (Ipv4Address dst, QueueEntry & entry)
 {
   Purge ();
-  for (std::vector<QueueEntry>::iterator i = m_queue.begin (); i != m_queue.end (); ++i)
+  FifoMap::iterator i = m_fifos.find (dst);
+  if (i == m_fifos.end ())
+    {
+      return false;
+    }
+  Fifo &fifo = i->second;
+  while (!m_nodes[fifo.head].live)
+    {
+      uint32_t dead = fifo.head;
+      fifo.head = m_nodes[dead].next;
+      FreeNode (dead);
+    }
+  uint32_t node = fifo.head;
+  entry = Kill (node);
+  if (fifo.size == 0)
+    {
+      EraseFifo (i);
+    }
+  else
+    {
+      fifo.head = m_nodes[node].next;
+      FreeNode (node);
+    }
+  return true;
+}
+
+bool
+RequestQueue::Find (Ipv4Address dst)
+{
+  return m_fifos.find (dst) != m_fifos.end ();
+}
+
+void
+RequestQueue::GetDestinations (std::vector<Ipv4Address> & dsts)
+{
+  Purge ();
+  for (FifoMap::const_iterator i = m_fifos.begin (); i != m_fifos.end (); ++i)
     {
-      if (i->GetIpv4Header ().GetDestination () == dst)
+      dsts.push_back (i->first);
+    }
+}
+
+void
+RequestQueue::Purge ()
+{
+  Time now = Simulator::Now ();
+  std::vector<QueueEntry> expired;
+  while (!m_expiry.empty () && m_expiry.top ().first < now)
+    {
+      uint32_t node = m_expiry.top ().second.first;
+      bool stale = !m_nodes[node].live || m_nodes[node].generation != m_expiry.top ().second.second;
+      m_expiry.pop ();
+      if (stale)
         {
-          entry = *i;
-          m_queue.erase (i);
-          return true;
+          continue;
+        }
+      Ipv4Address dst = m_nodes[node].dst;
+      expired.push_back (Kill (node));
+      FifoMap::iterator i = m_fifos.find (dst);
+      if (i->second.size == 0)
+        {
+          EraseFifo (i);
         }
     }
-  return false;
+  for (std::vector<QueueEntry>::const_iterator e = expired.begin (); e != expired.end (); ++e)
+    {
+      Drop (*e, "Drop outdated packet ");
+    }
 }
 
 bool
-RequestQueue::Find (Ipv4Address dst)
+RequestQueue::PopOldest (uint32_t & node)
 {
-  for (std::vector<QueueEntry>::const_iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  while (!m_expiry.empty ())
     {
-      if (i->GetIpv4Header ().GetDestination () == dst)
+      std::pair<uint32_t, uint32_t> record = m_expiry.top ().second;
+      m_expiry.pop ();
+      if (m_nodes[record.first].live && m_nodes[record.first].generation == record.second)
         {
+          node = record.first;
           return true;
         }
     }
   return false;
 }
 
-struct IsExpired
+QueueEntry
+RequestQueue::Kill (uint32_t node)
 {
-  bool
-  operator() (QueueEntry const & e) const
-  {
-    return (e.GetExpireTime () < Seconds (0));
-  }
-};
+  Node &n = m_nodes[node];
+  QueueEntry entry = n.entry;
+  n.entry = QueueEntry ();
+  n.live = false;
+  m_uids.erase (std::make_pair (n.uid, n.dst));
+  m_fifos[n.dst].size--;
+  m_size--;
+  return entry;
+}
 
 void
-RequestQueue::Purge ()
+RequestQueue::FreeNode (uint32_t node)
+{
+  m_nodes[node].generation++;
+  m_freeNodes.push_back (node);
+}
+
+void
+RequestQueue::EraseFifo (FifoMap::iterator fifo)
 {
-  IsExpired pred;
-  for (std::vector<QueueEntry>::iterator i = m_queue.begin (); i
-       != m_queue.end (); ++i)
+  uint32_t node = fifo->second.head;
+  while (node != NO_NODE)
     {
-      if (pred (*i))
-        {
-          Drop (*i, "Drop outdated packet ");
-        }
+      uint32_t next = m_nodes[node].next;
+      FreeNode (node);
+      node = next;
     }
-  m_queue.erase (std::remove_if (m_queue.begin (), m_queue.end (), pred),
-                 m_queue.end ());
+  m_fifos.erase (fifo);
 }
 
 void
@@ -146,5 +265,196 @@ RequestQueue::Drop (QueueEntry en, std::string reason)
   return;
 }
 
+void
+SalvageQueue::Enqueue (Ipv4Address nextHop, QueueEntry & entry)
+{
+  std::deque<QueueEntry> &queue = m_queues[nextHop];
+  Purge (queue);
+  entry.SetExpireTime (m_queueTimeout);
+  if (queue.size () >= m_maxLen)
+    {
+      PopFront (queue);
+    }
+  queue.push_back (entry);
+  m_uids[entry.GetPacket ()->GetUid ()] = nextHop;
+}
+
+bool
+SalvageQueue::Find (uint64_t uid, Ipv4Address & nextHop) const
+{
+  std::map<uint64_t, Ipv4Address>::const_iterator u = m_uids.find (uid);
+  if (u == m_uids.end ())
+    {
+      return false;
+    }
+  nextHop = u->second;
+  return true;
+}
+
+void
+SalvageQueue::Acknowledge (uint64_t uid)
+{
+  std::map<uint64_t, Ipv4Address>::iterator u = m_uids.find (uid);
+  if (u == m_uids.end ())
+    {
+      return;
+    }
+  NextHopQueues::iterator i = m_queues.find (u->second);
+  m_uids.erase (u);
+  if (i == m_queues.end ())
+    {
+      return;
+    }
+  for (std::deque<QueueEntry>::iterator j = i->second.begin (); j != i->second.end (); ++j)
+    {
+      if (j->GetPacket ()->GetUid () == uid)
+        {
+          i->second.erase (j);
+          break;
+        }
+    }
+  Purge (i->second);
+  if (i->second.empty ())
+    {
+      m_queues.erase (i);
+    }
+}
+
+void
+SalvageQueue::DequeueAll (Ipv4Address nextHop, std::vector<QueueEntry> & entries)
+{
+  NextHopQueues::iterator i = m_queues.find (nextHop);
+  if (i == m_queues.end ())
+    {
+      return;
+    }
+  Purge (i->second);
+  for (std::deque<QueueEntry>::const_iterator j = i->second.begin (); j != i->second.end (); ++j)
+    {
+      m_uids.erase (j->GetPacket ()->GetUid ());
+    }
+  entries.insert (entries.end (), i->second.begin (), i->second.end ());
+  m_queues.erase (i);
+}
+
+void
+SalvageQueue::Purge (std::deque<QueueEntry> & queue)
+{
+  while (!queue.empty () && queue.front ().GetExpireTime () < Seconds (0))
+    {
+      NS_LOG_LOGIC ("Forget salvage copy " << queue.front ().GetPacket ()->GetUid ());
+      PopFront (queue);
+    }
+}
+
+void
+SalvageQueue::PopFront (std::deque<QueueEntry> & queue)
+{
+  m_uids.erase (queue.front ().GetPacket ()->GetUid ());
+  queue.pop_front ();
+}
+
+uint32_t
+AggregationQueue::GetSubframeSize (QueueEntry const & entry)
+{
+  return SubframeHeader ().GetSerializedSize () + entry.GetIpv4Header ().GetSerializedSize ()
+         + entry.GetPacket ()->GetSize ();
+}
+
+Ptr<Packet>
+AggregationQueue::Pack (std::vector<QueueEntry> const & entries)
+{
+  Ptr<Packet> frame = Create<Packet> ();
+  for (std::vector<QueueEntry>::const_iterator i = entries.begin (); i != entries.end (); ++i)
+    {
+      Ptr<Packet> p = i->GetPacket ()->Copy ();
+      DataHeader data;
+      p->PeekHeader (data);
+      if (data.IsValid () && data.GetPosition ().HasSender ())
+        {
+          // the frame carries the sender once, for all its packets
+          PositionHeader position = data.GetPosition ();
+          position.SetSender (Ipv4Address::GetZero ());
+          data.Rewrite (p, position);
+        }
+      Ipv4Header header = i->GetIpv4Header ();
+      header.SetPayloadSize (p->GetSize ());
+      p->AddHeader (header);
+      p->AddHeader (SubframeHeader (p->GetSize ()));
+      frame->AddAtEnd (p);
+    }
+  return frame;
+}
+
+bool
+AggregationQueue::Unpack (Ptr<const Packet> subframes, std::vector<QueueEntry> & entries)
+{
+  Ptr<Packet> p = subframes->Copy ();
+  SubframeHeader subframe;
+  Ipv4Header header;
+  while (p->GetSize () >= subframe.GetSerializedSize ())
+    {
+      p->RemoveHeader (subframe);
+      if (subframe.GetLength () > p->GetSize ()
+          || subframe.GetLength () < header.GetSerializedSize ())
+        {
+          return false;
+        }
+      Ptr<Packet> inner = p->CreateFragment (0, subframe.GetLength ());
+      p->RemoveAtStart (subframe.GetLength ());
+      inner->RemoveHeader (header);
+      entries.push_back (QueueEntry (inner, header));
+    }
+  return p->GetSize () == 0;
+}
+
+uint32_t
+AggregationQueue::GetBytes (Ipv4Address nextHop) const
+{
+  Batches::const_iterator i = m_batches.find (nextHop);
+  return i == m_batches.end () ? 0 : i->second.bytes;
+}
+
+void
+AggregationQueue::Enqueue (Ipv4Address nextHop, QueueEntry const & entry, Ptr<Ipv4Route> route, EventId event)
+{
+  Batches::iterator i = m_batches.find (nextHop);
+  if (i == m_batches.end ())
+    {
+      i = m_batches.insert (std::make_pair (nextHop, Batch ())).first;
+      i->second.bytes = 0;
+      i->second.route = route;
+      i->second.flush = event;
+    }
+  i->second.entries.push_back (entry);
+  i->second.bytes += GetSubframeSize (entry);
+}
+
+Ptr<Ipv4Route>
+AggregationQueue::Dequeue (Ipv4Address nextHop, std::vector<QueueEntry> & entries)
+{
+  Batches::iterator i = m_batches.find (nextHop);
+  if (i == m_batches.end ())
+    {
+      return 0;
+    }
+  Ptr<Ipv4Route> route = i->second.route;
+  i->second.flush.Cancel ();
+  entries.insert (entries.end (), i->second.entries.begin (), i->second.entries.end ());
+  m_batches.erase (i);
+  return route;
+}
+
+void
+AggregationQueue::Clear ()
+{
+  for (Batches::iterator i = m_batches.begin (); i != m_batches.end (); ++i)
+    {
+      NS_LOG_LOGIC ("Drop " << i->second.entries.size () << " packets held for " << i->first);
+      i->second.flush.Cancel ();
+    }
+  m_batches.clear ();
+}
+
 }
 }
@@ -26,6 +26,7 @@
 #define SPIDER_H
 
 #include "spider-ptable.h"
+#include "spider-forwarding.h"
 #include "ns3/node.h"
 #include "spider-packet.h"
 #include "ns3/ipv4-routing-protocol.h"
@@ -59,6 +60,8 @@ class RoutingProtocol : public Ipv4RoutingProtocol
 public:
   static TypeId GetTypeId (void);
   static const uint32_t SPIDER_PORT;
+  /// IP protocol number of aggregate frames, see AggregationDelay
+  static const uint8_t AGGREGATE_PROTOCOL;
 
   /// c-tor                        
   RoutingProtocol ();
@@ -81,9 +84,13 @@ public:
   virtual void NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address);
   virtual void SetIpv4 (Ptr<Ipv4> ipv4);
   virtual void RecvSPIDER (Ptr<Socket> socket);
-  virtual void UpdateRouteToNeighbor (Ipv4Address sender, Ipv4Address receiver, Vector Pos);
+  virtual void UpdateRouteToNeighbor (Ipv4Address sender, Ipv4Address receiver, Vector Pos, Vector velocity, Time holdTime);
   virtual void SendHello ();
   virtual bool IsMyOwnAddress (Ipv4Address src);
+  /// Interface a next hop was heard on, else the one whose subnet holds it
+  uint32_t GetOutputInterface (Ipv4Address nextHop);
+  /// True if dst is the subnet-directed broadcast address of a SPIDER interface
+  bool IsBroadcast (Ipv4Address dst);
 
   Ptr<Ipv4> m_ipv4;
   /// Raw socket per each IP interface, map socket -> iface address (IP + mask)
@@ -115,14 +122,55 @@ public:
     return;
   }
 
+  /// HELLO emission counters since the protocol started, see AdaptiveHello
+  struct BeaconStats
+  {
+    uint32_t sent;        ///< HELLOs sent
+    uint32_t moved;       ///< HELLOs sent because the node drifted from its advertised track
+    uint32_t refreshed;   ///< HELLOs sent because the advertised hold time was about to lapse
+    uint32_t suppressed;  ///< timer ticks that sent no HELLO
+    uint32_t received;    ///< HELLOs received
+  };
+  const BeaconStats & GetBeaconStats () const
+  {
+    return m_beaconStats;
+  }
+  /// HELLOs sent per second since the protocol started
+  double GetBeaconRate () const;
+
+  /// Recovery-mode counters since the protocol started, see MaxFaceChanges
+  struct RecoveryStats
+  {
+    uint32_t entered;     ///< packets that entered recovery-mode at this node
+    uint32_t faceChanges; ///< faces changed at this node
+    uint32_t loops;       ///< packets dropped on the first edge of their face again
+    uint32_t faceLimits;  ///< packets dropped past MaxFaceChanges
+    uint32_t deadEnds;    ///< packets dropped without a planar neighbour
+  };
+  const RecoveryStats & GetRecoveryStats () const
+  {
+    return m_recoveryStats;
+  }
+
 
 private:
   /// Start protocol operation
   void Start ();
+  /// Obstacles of RepulsionMode: those of ObstacleFile, else the locationX, locationY, object_radius hole
+  Ptr<ObstacleSet> GetObstacles () const;
   /// Queue packet and send route request
   void DeferredRouteOutput (Ptr<const Packet> p, const Ipv4Header & header, UnicastForwardCallback ucb, ErrorCallback ecb);
-  /// If route exists and valid, forward packet.
+  /// Sends the HELLOs that are due and re-schedules
   void HelloTimerExpire ();
+  /// Beacon period of this node: HelloInterval while forwarding, HelloKeepAlive when idle
+  Time GetHelloPeriod () const;
+  /// Adds the address of interface oif to a data header carrying the position of this node, see PositionPiggyback
+  void StampSender (PositionHeader &hdr, uint32_t oif);
+  /// Refreshes the neighbour entry of the previous hop of a data packet starting with the SPIDER headers, received on iif
+  void LearnSender (Ptr<const Packet> p, uint32_t iif);
+  /// Promiscuous IPv4 handler, learns from data frames addressed to other nodes
+  void Overhear (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol,
+                 const Address &from, const Address &to, NetDevice::PacketType packetType);
 
   /// Queue packet and send route request
   Ptr<Ipv4Route> LoopbackRoute (const Ipv4Header & header, Ptr<NetDevice> oif);
@@ -132,38 +180,129 @@ private:
 
   /// Find socket with local interface address iface
   Ptr<Socket> FindSocketWithInterfaceAddress (Ipv4InterfaceAddress iface) const;
+  /// Forgets neighbours, routes and held packets once no interface runs SPIDER
+  void StopRouting ();
 
   //Check packet from deffered route output queue and send if position is already available
-//returns true if the IP should be erased from the list (was sent/droped)
+//returns true if the packets to dst were sent/droped
   bool SendPacketFromQueue (Ipv4Address dst);
 
-  //Calls SendPacketFromQueue and re-schedules
+  /// Safety timer, forgets the destinations whose queued packets all expired and re-schedules
   void CheckQueue ();
+  /// Sends the packets queued to dst if their route can be resolved now
+  void ReleaseQueue (Ipv4Address dst);
+  /// A neighbour joined or moved: releases the destinations waiting for one
+  void ProcessNeighborUpdate (Ipv4Address neighbor);
 
-  void RecoveryMode(Ipv4Address dst, Ptr<Packet> p, UnicastForwardCallback ucb, Ipv4Header header);
+  /// Forwards p, starting with data, in recovery-mode from the state in hdr
+  void RecoveryMode(Ipv4Address dst, Ptr<Packet> p, DataHeader data, PositionHeader hdr, UnicastForwardCallback ucb, Ipv4Header header);
+
+  /// Next hop chosen by m_engine, reused from m_nextHops while still valid
+  Ipv4Address SelectNextHop (NextHopCache::Mode mode, Ipv4Address dst, Vector dstPos, Vector myPos);
+  /// As SelectNextHop, spreading the flow from source to dst over up to MultipathK next hops
+  Ipv4Address SelectFlowNextHop (NextHopCache::Mode mode, Ipv4Address source, Ipv4Address dst, Vector dstPos, Vector myPos);
+  /// Route to dst through nextHop, reused from m_nextHops when it matches
+  Ptr<Ipv4Route> GetRoute (NextHopCache::Mode mode, Ipv4Address dst, Ipv4Address source, Ipv4Address nextHop, Ptr<NetDevice> oif);
+  /// Records the decision behind a route RouteOutput returns, see m_routeContext
+  Ptr<Ipv4Route> SetRouteContext (Ptr<Ipv4Route> route, Vector dstPos, uint32_t updated, Ipv4Address nextHop);
+  /// Hands a packet to route->GetGateway () through ucb, keeping a copy in m_salvage
+  void ForwardToNextHop (Ptr<Ipv4Route> route, Ptr<Packet> p, const Ipv4Header &header, UnicastForwardCallback ucb, ErrorCallback ecb);
+  /// Holds p for the next hop of route when it is small enough to share a frame, else sends it
+  bool Aggregate (Ptr<Ipv4Route> route, Ptr<Packet> p, const Ipv4Header &header, UnicastForwardCallback ucb, ErrorCallback ecb);
+  /// Sends the packets held for nextHop, in one aggregate frame if there are several
+  void FlushAggregate (Ipv4Address nextHop);
+  /// Splits an aggregate frame, starting with its shared DataHeader, into its packets
+  void Disaggregate (Ptr<const Packet> frame, std::vector<QueueEntry> &entries) const;
+  /// PHY TX notification, records the packet a unicast data frame carries if a copy of it is kept
+  void ProcessPhyTxBegin (Ptr<const Packet> packet, double txPowerW);
+  /// Returns the uid of the packet the frame of hdr carries, see m_txFrames, and forgets the frame
+  bool TakeTxFrame (WifiMacHeader const &hdr, uint64_t &uid);
+  /// MAC TX success notification, the copy of the packet the frame carried is no longer needed
+  void ProcessTxOk (WifiMacHeader const &hdr);
+  /// MAC TX failure notification for a next hop that is no longer a neighbour
+  void ProcessTxError (WifiMacHeader const &hdr);
+  /// Forwards again the packets handed to nextHop, which the MAC failed to reach
+  void Salvage (Ipv4Address nextHop);
   
   uint32_t MaxQueueLen;                  ///< The maximum number of packets that we allow a routing protocol to buffer.
   Time MaxQueueTime;                     ///< The maximum period of time that a routing protocol is allowed to buffer a packet for.
   RequestQueue m_queue;
+  SalvageQueue m_salvage;                ///< packets handed to the MAC, forwarded again if their next hop fails
+  /// A unicast frame: transmitter, receiver and MAC sequence number
+  typedef std::pair<std::pair<Mac48Address, Mac48Address>, uint16_t> TxFrame;
+  std::map<TxFrame, uint64_t> m_txFrames; ///< uid of the packet in each frame sent with a copy in m_salvage
+  AggregationQueue m_aggregate;          ///< small packets held to share a frame to their next hop
 
   Timer HelloIntervalTimer;
   Timer CheckQueueTimer;
   uint8_t LocationServiceName;
   PositionTable m_neighbors;
+  Ptr<ForwardingEngineBase> m_engine;    ///< next-hop policies selected in Start ()
+  NextHopCache m_nextHops;               ///< recent m_engine decisions
+  FlowSpreader m_flows;                  ///< next hop of each packet of a flow, see MultipathK
+  std::vector<WeightedNeighbor> m_hops;  ///< scratch of SelectFlowNextHop
+  /// Decision of the last RouteOutput call. UDP and TCP hand the packet to
+  /// AddHeaders right after, with the same route, which consumes it instead
+  /// of looking the destination up and scoring the neighbours again.
+  struct RouteContext
+  {
+    Ptr<Ipv4Route> route;                ///< route returned, 0 once consumed
+    Time time;                           ///< when it was returned
+    Vector dstPos;                       ///< destination position looked up
+    uint32_t updated;                    ///< update time of dstPos
+    Ipv4Address nextHop;                 ///< next hop, zero if the packet was deferred
+  };
+  RouteContext m_routeContext;
+  //reuse next hops while in the same NextHopCacheCell and until the neighbour table or energies (EnergyDrift) change
+  double NextHopCacheCell;
+  double EnergyDrift;
+  //spread each flow over the MultipathK best next hops within MultipathSlack of the best objective
+  uint32_t MultipathK;
+  double MultipathSlack;
+  //faces a packet may change in recovery-mode, it is dropped beyond that or on the first edge of its face again
+  uint8_t MaxFaceChanges;
+  RecoveryStats m_recoveryStats;
   bool PerimeterMode;
   //set 1 to use avoidance with EGF
   uint8_t RepulsionMode;
   //set location and radius of obstacle
   double locationX,locationY,object_radius;
+  //or load the obstacles from a file, acting up to ObstacleInfluence beyond their radius
+  std::string ObstacleFile;
+  double ObstacleInfluence;
   //set energy model
   double lambda;
+  //maximum age of a cached neighbour residual-energy reading
+  Time EnergyRefreshInterval;
+  //neighbour entries expire after NeighborLifetime, or earlier once predicted out of RadioRange
+  double RadioRange;
+  Time NeighborLifetime;
+  //adaptive beaconing: HELLO on drift beyond HelloDistance or before the advertised hold time lapses
+  bool AdaptiveHello;
+  double HelloDistance;
+  Time HelloKeepAlive;
+  Time m_startTime;
+  Time m_lastActive;                     ///< last time this node originated or forwarded data
+  //refresh neighbours from the positions data packets carry, overheard ones too with OverhearPositions
+  bool PositionPiggyback;
+  bool OverhearPositions;
+  //MAC TX errors blacklist the next hop and salvage the packets handed to it
+  Time BlacklistTimeout;
+  Time SalvageTimeout;
+  //forwarded packets to the same next hop share a frame of up to AggregationSize bytes, held up to AggregationDelay
+  Time AggregationDelay;
+  uint32_t AggregationSize;
+  Time m_lastAdvertised;                 ///< last HELLO, or data frame every neighbour hears
+  Vector m_lastAdvertisedPos;
+  Time m_lastHelloPeriod;
+  Vector m_lastHelloVelocity;
+  BeaconStats m_beaconStats;
   //std::vector<Ptr<NetDevice>> devices;
   NodeContainer node;
 //  Ptr<SimpleDeviceEnergyModel> sem = CreateObject<SimpleDeviceEnergyModel> ();
 //  Ptr<EnergySourceContainer> esCont = CreateObject<EnergySourceContainer> ();
 //  Ptr<LiIonEnergySource> es = CreateObject<LiIonEnergySource> ();
 //
-  std::list<Ipv4Address> m_queuedAddresses;
   Ptr<LocationService> m_locationService;
 
   IpL4Protocol::DownTargetCallback m_downTargetUdp;